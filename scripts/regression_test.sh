@@ -0,0 +1,436 @@
+#!/bin/sh
+#
+# Regression checks of the classification variants: every variant has to reproduce the
+# result lines of a reference CLASSIFY run (header lines are not compared). The reads are
+# cut deterministically from test_data/test.genomes.fa.gz, i.e. no extra data is needed.
+#
+# usage: scripts/regression_test.sh [EDeNseq binary] [work directory]
+#        (make check in src builds the program and the examples and runs this script)
+#
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BIN=$(cd "$(dirname "${1:-$ROOT/src/EDeNseq}")" && pwd)/$(basename "${1:-$ROOT/src/EDeNseq}")
+WORK=${2:-$(mktemp -d /tmp/edenseq_regression.XXXXXX)}
+CLIENT=$ROOT/src/examples/serve_client
+GENOMES=$ROOT/test_data/test.genomes.fa.gz
+INDEX_SEQS=$GENOMES
+BED=$ROOT/test_data/test.small.bed
+
+OPTS="--numThreads 4 -b 30 -F 5 --num_hash_shingles 3 --num_repeat_hash_functions 3 -r 4 -d 7 --min_radius 4 --min_distance 7 --seq_window 70 --index_seq_shift 10 --seq_shift 9 --pure_approximate_sim 0"
+
+FAILED=0
+mkdir -p "$WORK"
+echo "EDeNseq regression checks in $WORK"
+
+# reads: 150 nt every 1009 nt of each genome, every 2nd read reverse complemented, every 5th
+# in lower case, every 3rd header with a description and every 10th read repeated (read cache);
+# three reads are shorter than a window (bins)
+zcat "$GENOMES" | awk '
+	function revcomp(s,   i, r, c){
+		r = "";
+		for (i = length(s); i > 0; i--){
+			c = substr(s, i, 1);
+			r = r (c == "A" ? "T" : c == "C" ? "G" : c == "G" ? "C" : c == "T" ? "A" : "N");
+		}
+		return r;
+	}
+	function cut(   p, s, h){
+		for (p = 1; p + 150 <= length(seq); p += 1009){
+			n++;
+			s = toupper(substr(seq, p, 150));
+			if (n % 2 == 0) s = revcomp(s);
+			if (n % 5 == 0) s = tolower(s);
+			h = ">read" n "_" name;
+			if (n % 3 == 0) h = h " pos " p;
+			print h; print s;
+			if (n % 10 == 0){ print ">dup" n "_" name; print s; }
+		}
+	}
+	/^>/ { if (seq != "") cut(); name = substr($1, 2); gsub(/[^A-Za-z0-9_.]/, "_", name); seq = ""; next }
+	{ seq = seq $0 }
+	END {
+		if (seq != "") cut();
+		for (i = 1; i <= 3; i++){ print ">short" i " too short"; print "ACGTACGTAC"; }
+	}' > "$WORK/reads.fa"
+
+# long sequences that are split over several chunks: the genomes are concatenated and cut into
+# contigs of 500000 nt (the test genomes are shorter than a chunk)
+zcat "$GENOMES" | awk '
+	!/^>/ { seq = seq $0 }
+	END { for (p = 1; p <= length(seq); p += 500000){ print ">contig" ++n; print substr(seq, p, 500000) } }' > "$WORK/long.fa"
+
+fail(){
+	echo "FAIL $1: $2"
+	FAILED=1
+}
+
+# run <name> <input> [options]: CLASSIFY into $WORK/<name>, sorted result lines in res.sorted
+run(){
+	name=$1; input=$2; shift 2
+	run_bed "$name" "$BED" "$input" "$@"
+}
+
+# run_bed <name> <bed> <input> [options]: as run with the index regions <bed> (and its index <bed>.bhi if present)
+# of the sequences $INDEX_SEQS
+run_bed(){
+	name=$1; bed=$2; input=$3; shift 3
+	dir=$WORK/$name
+	rm -rf "$dir"; mkdir -p "$dir"; cp "$bed" "$dir/"
+	[ -f "$bed.bhi" ] && cp "$bed.bhi" "$dir/"
+	if ! (cd "$dir" && "$BIN" -a CLASSIFY -i "$input" --index_seqs "$INDEX_SEQS" --index_bed "$dir/$(basename "$bed")" $OPTS -y "$dir/" "$@" > "$dir/log.txt" 2>&1) \
+		|| grep -q "ERROR" "$dir/log.txt"; then
+		fail "$name" "EDeNseq failed, see $dir/log.txt"
+		return 1
+	fi
+	zcat "$dir/$(basename "$input").classified.tab.gz" | grep -v "^#" | sort > "$dir/res.sorted"
+	zcat "$dir/$(basename "$input").classified.tab.gz" | named > "$dir/res.named"
+	return 0
+}
+
+# result lines with label names instead of label ids (IDX/VALS pairs and MAX_IDX sorted by name),
+# i.e. comparable between indices that number the labels differently (merged or updated indices)
+named(){
+	awk -F'\t' -v OFS='\t' '
+		function sortjoin(a, n,   i, j, t, r){
+			for (i = 2; i <= n; i++)
+				for (j = i; j > 1 && a[j-1] > a[j]; j--){ t = a[j]; a[j] = a[j-1]; a[j-1] = t; }
+			r = "";
+			for (i = 1; i <= n; i++) r = r a[i] ",";
+			return r;
+		}
+		/^#HIST_IDX/ { label[$2] = $4; next }
+		/^#/ { next }
+		{
+			n = split($8, idx, ","); split($9, val, ",");
+			for (i = 1; i < n; i++) p[i] = label[idx[i]] ":" val[i];
+			$8 = sortjoin(p, n-1); $9 = "";
+			n = split($10, idx, ",");
+			for (i = 1; i < n; i++) p[i] = label[idx[i]];
+			$10 = sortjoin(p, n-1);
+			print;
+		}' | sort
+}
+
+# check <name> <reference name> [res.named]: equal result lines
+check(){
+	res=${3:-res.sorted}
+	if cmp -s "$WORK/$2/$res" "$WORK/$1/$res"; then
+		echo "ok   $1"
+	else
+		fail "$1" "results differ from $2 (diff $WORK/$2/$res $WORK/$1/$res)"
+	fi
+}
+
+# FASTA records as sorted "header<TAB>sequence" lines
+records(){
+	awk '/^>/ { if (h != "") print h "\t" s; h = $0; s = ""; next } { s = s $0 } END { if (h != "") print h "\t" s }' | sort
+}
+
+run ref "$WORK/reads.fa" || exit 1
+[ -s "$WORK/ref/res.sorted" ] || { echo "FAIL ref: no results"; exit 1; }
+
+# shared memory index: attached runs give the same results; a segment that is removed while a
+# process is attached is retired and removed by the last process, the attachment of a crashed
+# process (SERVE killed) is reclaimed by --shm_remove
+SHM=edenseq_regression_$$
+shm(){
+	(cd "$WORK/shm_pub" && "$BIN" -a PUBLISH_INDEX --shm_name "$SHM" --index_seqs "$GENOMES" --index_bed "$WORK/shm_pub/test.small.bed" $OPTS -y "$WORK/shm_pub/" "$@" >> "$WORK/shm_pub/log.txt" 2>&1)
+}
+rm -rf "$WORK/shm_pub"; mkdir -p "$WORK/shm_pub"; cp "$BED" "$WORK/shm_pub/"
+if shm && [ -e "/dev/shm/$SHM" ]; then
+	rm -rf "$WORK/shm"
+	run shm "$WORK/reads.fa" --shm_name "$SHM" &
+	attached=$!
+	i=0
+	while ! grep -q "Attached shared index" "$WORK/shm/log.txt" 2>/dev/null && [ $i -lt 300 ] && kill -0 $attached 2>/dev/null; do
+		sleep 1; i=$((i+1))
+	done
+	shm --shm_remove
+	wait $attached && check shm ref
+	[ -e "/dev/shm/$SHM" ] && fail shm "segment was not removed after the last process detached"
+
+	shm
+	dir=$WORK/shm_serve
+	rm -rf "$dir"; mkdir -p "$dir"; cp "$BED" "$dir/"
+	(cd "$dir" && exec "$BIN" -a SERVE --serve_socket "$dir/edenseq.sock" --shm_name "$SHM" --index_bed "$dir/test.small.bed" $OPTS -y "$dir/" > "$dir/log.txt" 2>&1) &
+	server=$!
+	i=0
+	while [ ! -S "$dir/edenseq.sock" ] && [ $i -lt 300 ] && kill -0 $server 2>/dev/null; do
+		sleep 1; i=$((i+1))
+	done
+	kill -9 $server 2>/dev/null
+	wait $server 2>/dev/null
+	shm --shm_remove
+	if grep -q "Reclaim 1 attachments" "$WORK/shm_pub/log.txt" && [ ! -e "/dev/shm/$SHM" ]; then
+		echo "ok   shm_crash"
+	else
+		fail shm_crash "the attachment of the killed process was not reclaimed, see $WORK/shm_pub/log.txt"
+	fi
+else
+	fail shm "cannot publish the index, see $WORK/shm_pub/log.txt"
+fi
+[ -e "/dev/shm/$SHM" ] && shm --shm_remove --shm_force
+
+# out-of-core index build: sorted runs are merged into the index file (the denser index
+# with --index_seq_shift 2 gives several runs)
+if run dense "$WORK/reads.fa" --index_seq_shift 2 && run spill "$WORK/reads.fa" --index_seq_shift 2 --max_build_memory 1; then
+	check spill dense
+	grep -q "merge [2-9][0-9]* index runs" "$WORK/spill/log.txt" || fail spill "the index was not built from several runs"
+fi
+
+# index shards: the regions are split into two BED files, the merge of their indices gives the
+# same results as the index of all regions
+head -n 31 "$BED" > "$WORK/shard_a.bed"
+tail -n +32 "$BED" > "$WORK/shard_b.bed"
+head -n 20 "$WORK/reads.fa" > "$WORK/few.fa"
+if run_bed shard_a "$WORK/shard_a.bed" "$WORK/few.fa" && run_bed shard_b "$WORK/shard_b.bed" "$WORK/few.fa"; then
+	dir=$WORK/merge_index
+	rm -rf "$dir"; mkdir -p "$dir"
+	cat "$WORK/shard_a.bed" "$WORK/shard_b.bed" > "$dir/merged.bed"
+	if (cd "$dir" && "$BIN" -a MERGE_INDEX --index_merge_files "$WORK/shard_a/shard_a.bed.bhi,$WORK/shard_b/shard_b.bed.bhi" --index_merge_output merged.bed.bhi -y "$dir/" > "$dir/log.txt" 2>&1); then
+		run_bed merge "$dir/merged.bed" "$WORK/reads.fa" && check merge ref res.named
+		grep -q "write index file" "$WORK/merge/log.txt" && fail merge "the merged index was not used"
+	else
+		fail merge "MERGE_INDEX failed, see $dir/log.txt"
+	fi
+fi
+
+# merge of indices with key filters: the filters are built again for the merged keys
+if run_bed shard_a_bloom "$WORK/shard_a.bed" "$WORK/few.fa" --index_bloom_bits 12 && run_bed shard_b_bloom "$WORK/shard_b.bed" "$WORK/few.fa" --index_bloom_bits 12; then
+	dir=$WORK/merge_bloom_index
+	rm -rf "$dir"; mkdir -p "$dir"
+	cat "$WORK/shard_a.bed" "$WORK/shard_b.bed" > "$dir/merged.bed"
+	if (cd "$dir" && "$BIN" -a MERGE_INDEX --index_merge_files "$WORK/shard_a_bloom/shard_a.bed.bhi,$WORK/shard_b_bloom/shard_b.bed.bhi" --index_merge_output merged.bed.bhi -y "$dir/" > "$dir/log.txt" 2>&1); then
+		run_bed merge_bloom "$dir/merged.bed" "$WORK/reads.fa" && check merge_bloom ref res.named
+		grep -q "key filters with 12 bits per key" "$WORK/merge_bloom/log.txt" || fail merge_bloom "the merged index has no key filters"
+	else
+		fail merge_bloom "MERGE_INDEX failed, see $dir/log.txt"
+	fi
+fi
+
+# index update: the regions of the second shard are added to the index of the first one, which
+# is replaced (via a temporary file) by an index with the results of the index of all regions
+if [ -f "$WORK/shard_a/shard_a.bed.bhi" ]; then
+	dir=$WORK/update_index
+	rm -rf "$dir"; mkdir -p "$dir"
+	cp "$WORK/shard_a.bed" "$WORK/shard_a/shard_a.bed.bhi" "$WORK/shard_b.bed" "$dir/"
+	if (cd "$dir" && "$BIN" -a UPDATE_INDEX --index_bed "$dir/shard_a.bed" --index_update_bed "$dir/shard_b.bed" --index_seqs "$GENOMES" $OPTS -y "$dir/" > "$dir/log.txt" 2>&1) \
+		&& ! grep -q "ERROR" "$dir/log.txt"; then
+		cmp -s "$WORK/shard_a/shard_a.bed.bhi" "$dir/shard_a.bed.bhi" && fail update "the index file was not replaced"
+		[ -e "$dir/shard_a.bed.bhi.tmp" ] && fail update "temporary index file was left"
+		cat "$dir/shard_a.bed" "$dir/shard_b.bed" > "$dir/updated.bed"
+		cp "$dir/shard_a.bed.bhi" "$dir/updated.bed.bhi"
+		run_bed update "$dir/updated.bed" "$WORK/reads.fa" && check update ref res.named
+	else
+		fail update "UPDATE_INDEX failed, see $dir/log.txt"
+	fi
+fi
+
+# several indexes in one pass with the read cache: the results of each index are the ones of a run
+# with this index only
+if [ -f "$WORK/shard_a/shard_a.bed.bhi" ] && [ -f "$WORK/shard_b/shard_b.bed.bhi" ] \
+	&& run_bed multi_a "$WORK/shard_a/shard_a.bed" "$WORK/reads.fa" && run_bed multi_b "$WORK/shard_b/shard_b.bed" "$WORK/reads.fa"; then
+	dir=$WORK/multi
+	rm -rf "$dir"; mkdir -p "$dir"
+	for f in "$WORK/ref/test.small.bed" "$WORK/shard_a/shard_a.bed" "$WORK/shard_b/shard_b.bed"; do cp "$f" "$f.bhi" "$dir/"; done
+	if (cd "$dir" && "$BIN" -a CLASSIFY -i "$WORK/reads.fa" --index_seqs "$GENOMES" --index_bed "$dir/test.small.bed" --index_bed "$dir/shard_a.bed" --index_bed "$dir/shard_b.bed" \
+		--read_cache_size 100000 $OPTS -y "$dir/" > "$dir/log.txt" 2>&1) && ! grep -q "ERROR" "$dir/log.txt"; then
+		differ=""
+		for i in ref:test.small.bed multi_a:shard_a.bed multi_b:shard_b.bed; do
+			zcat "$dir/reads.fa.${i#*:}.classified.tab.gz" | grep -v "^#" | sort > "$dir/res.${i%%:*}"
+			cmp -s "$WORK/${i%%:*}/res.sorted" "$dir/res.${i%%:*}" || differ="$differ ${i#*:}"
+		done
+		[ -z "$differ" ] && echo "ok   multi" || fail multi "results of$differ differ from the runs with a single index, see $dir"
+		grep -q "Read cache: [1-9]" "$dir/log.txt" || fail multi "no cache hits"
+		grep -q "write index file" "$dir/log.txt" && fail multi "the indices were built again"
+	else
+		fail multi "EDeNseq failed, see $dir/log.txt"
+	fi
+fi
+
+# pruning: keys of more than one label are removed, i.e. reads lose hits but never gain any;
+# the out-of-core build prunes while merging its runs and has to give the same index
+if run prune "$WORK/reads.fa" --prune_max_bin_size 1; then
+	grep -q "Pruned keys *: [1-9]" "$WORK/prune/log.txt" || fail prune "no keys were pruned"
+	zcat "$WORK/prune/reads.fa.classified.tab.gz" | grep -q "^#PARAM	PRUNED	1" || fail prune "output is not tagged as pruned"
+	awk -F'\t' 'FNR == NR { sum[$1] = $6; next }
+		!($1 in sum) || $6 > sum[$1] { more++ } $6 < sum[$1] { less++ }
+		END { exit !(more == 0 && less > 0) }' "$WORK/ref/res.sorted" "$WORK/prune/res.sorted" \
+		&& echo "ok   prune" || fail prune "pruned index does not only remove hits"
+	run prune_spill "$WORK/reads.fa" --prune_max_bin_size 1 --max_build_memory 1 && check prune_spill prune
+fi
+
+# index presizing: four copies of the genomes (the key sample covers the first copy and part of the
+# second one) must not be extrapolated linearly, the estimate has to stay close to the actual keys
+dir=$WORK/presize
+rm -rf "$dir"; mkdir -p "$dir"
+zcat "$GENOMES" | awk '{ line[NR] = $0 } END { for (c = 1; c <= 4; c++) for (i = 1; i <= NR; i++) print (line[i] ~ /^>/) ? ">c" c "_" substr(line[i], 2) : line[i] }' > "$dir/copies.fa"
+awk '{ for (c = 1; c <= 4; c++) print "c" c "_" $0 }' "$BED" > "$dir/copies.bed"
+if (cd "$dir" && "$BIN" -a CLASSIFY -i "$WORK/few.fa" --index_seqs "$dir/copies.fa" --index_bed "$dir/copies.bed" $OPTS -y "$dir/" > "$dir/log.txt" 2>&1); then
+	awk '/^Estimate index size from a sample/ { sampled = ($8 < $10) }
+		/estimated [0-9]+ actual [0-9]+/ { n++; if ($6 > 1.5*$8) over++ }
+		END { exit !(sampled && n > 0 && over == 0) }' "$dir/log.txt" \
+		&& echo "ok   presize" || fail presize "key estimate from a partial sample is too large, see $dir/log.txt"
+else
+	fail presize "EDeNseq failed, see $dir/log.txt"
+fi
+
+# index layouts
+run inline "$WORK/reads.fa" --index_inline_bins && check inline ref
+run quotient "$WORK/reads.fa" --index_label_sets --index_quotient_keys && check quotient ref
+run bloom "$WORK/reads.fa" --index_bloom_bits 12 && check bloom ref
+run labelsets "$WORK/reads.fa" --index_label_sets && check labelsets ref
+
+# compressed label sets: overlapping pieces of 2000 nt of three copies of the first shard, each
+# piece with its own label, give bins of about 12 labels (more than one group of 8) and label
+# ids of the copies that are far apart (two byte deltas); both decoders give the uncompressed results
+dir=$WORK/pieces_data
+rm -rf "$dir"; mkdir -p "$dir"
+zcat "$GENOMES" | awk '{ line[NR] = $0 } END { for (c = 1; c <= 3; c++) for (i = 1; i <= NR; i++) print (line[i] ~ /^>/) ? ">c" c "_" substr(line[i], 2) : line[i] }' > "$dir/copies.fa"
+awk -v OFS='\t' '{ for (c = 1; c <= 3; c++) for (p = $2; p < $3; p += 500){ e = (p + 2000 < $3) ? p + 2000 : $3; print "c" c "_" $1, p, e, "c" c "_" NR "_" p } }' "$WORK/shard_a.bed" > "$dir/pieces.bed"
+INDEX_SEQS=$dir/copies.fa
+if run_bed pieces "$dir/pieces.bed" "$WORK/reads.fa"; then
+	if run_bed compress "$WORK/pieces/pieces.bed" "$WORK/reads.fa" --index_compress_bins; then
+		check compress pieces
+		if grep -q ssse3 /proc/cpuinfo 2>/dev/null; then
+			grep -q "label set decoder: SSSE3" "$WORK/compress/log.txt" || fail compress "the vectorised decoder was not used"
+		fi
+	fi
+	if run_bed compress_scalar "$WORK/pieces/pieces.bed" "$WORK/reads.fa" --index_compress_bins --index_scalar_decoder; then
+		check compress_scalar pieces
+		grep -q "label set decoder: scalar" "$WORK/compress_scalar/log.txt" || fail compress_scalar "the scalar decoder was not used"
+	fi
+fi
+INDEX_SEQS=$GENOMES
+
+# sparse read histograms: MAX reports exactly the labels of the reference with the maximum count;
+# the histogram of a single strand never has more hits of a label than the one of both strands
+if run max "$WORK/reads.fa" --output_type MAX; then
+	awk -F'\t' -v OFS='\t' '{
+		n = split($8, idx, ","); split($9, val, ",");
+		$8 = ""; $9 = "";
+		for (i = 1; i < n; i++) if (val[i] == $7) { $8 = $8 idx[i] ","; $9 = $9 val[i] "," }
+		print }' "$WORK/ref/res.sorted" > "$WORK/max/res.expected"
+	cmp -s "$WORK/max/res.expected" "$WORK/max/res.sorted" && echo "ok   max" || fail max "MAX results differ from the maximum labels of ref (diff $WORK/max/res.expected $WORK/max/res.sorted)"
+fi
+if run strand "$WORK/reads.fa" --output_type ALL_STRAND; then
+	awk -F'\t' 'FNR == NR { line[$1] = $0; n = split($8, idx, ","); split($9, val, ","); for (i = 1; i < n; i++) count[$1, idx[i]] = val[i]; next }
+		$2 == "." { if ($0 == line[$1]) both++; else other++; next }
+		{ single++; n = split($8, idx, ","); split($9, val, ","); for (i = 1; i < n; i++) if (val[i] > count[$1, idx[i]]) other++ }
+		END { exit !(other == 0 && both > 0 && single > 0) }' "$WORK/ref/res.sorted" "$WORK/strand/res.sorted" \
+		&& echo "ok   strand" || fail strand "strand results exceed the results of both strands"
+fi
+
+# abundance summary: the counts of the best labels (MAX_IDX) of the reference results
+if run abundance "$WORK/reads.fa" --abundance_output; then
+	awk -F'\t' '{
+		n = split($10, best, ",") - 1;
+		if (n == 0) { unclassified++; next }
+		classified++;
+		for (i = 1; i <= n; i++){ if (n == 1) unique[best[i]]++; else ambiguous[best[i]]++; assigned[best[i]] += 1/n }
+	}
+	END {
+		print "#SEQUENCES\t" classified + unclassified; print "#CLASSIFIED\t" classified; print "#UNCLASSIFIED\t" unclassified + 0;
+		for (l in assigned) printf "%s\t%d\t%d\t%.6g\t%.6g\n", l, unique[l], ambiguous[l], assigned[l], assigned[l]/classified;
+	}' "$WORK/ref/res.sorted" | sort > "$WORK/abundance/abundance.expected"
+	awk -F'\t' -v OFS='\t' '/^#IDX/ { next } /^#/ { print; next } { print $1, $3, $4, $5, $6 }' "$WORK/abundance/reads.fa.abundance.tab" | sort > "$WORK/abundance/abundance.sorted"
+	check abundance ref
+	cmp -s "$WORK/abundance/abundance.expected" "$WORK/abundance/abundance.sorted" \
+		|| fail abundance "abundance summary differs from the best labels of ref (diff $WORK/abundance/abundance.expected $WORK/abundance/abundance.sorted)"
+fi
+
+# batch queries: the hits of a batch of reads are looked up in sorted key order
+run batch "$WORK/reads.fa" --batch_query && check batch ref
+
+# two tier screen: with all sub indices and one hit the screen passes every read with a hit; a
+# stricter screen only removes the hits of strands, the other results are the ones of the full query
+run screen_all "$WORK/reads.fa" --screen_hash_functions 5 --screen_min_hits 1 && check screen_all ref
+if run screen "$WORK/reads.fa" --screen_hash_functions 2 --screen_min_hits 2; then
+	grep -q "Screen with 2 hash functions: [0-9]* of [1-9]" "$WORK/screen/log.txt" || fail screen "no screen statistics"
+	awk -F'\t' 'FNR == NR { line[$1] = $0; sum[$1] = $6; next }
+		$0 == line[$1] { same++; next } $6 < sum[$1] { less++; next } { other++ }
+		END { exit !(other == 0 && same > 0 && less > 0) }' "$WORK/ref/res.sorted" "$WORK/screen/res.sorted" \
+		&& echo "ok   screen" || fail screen "screened reads differ from the reference beyond losing hits"
+fi
+
+# read cache: repeated reads are answered from the cache
+if run cache "$WORK/reads.fa" --read_cache_size 100000; then
+	check cache ref
+	grep -q "Read cache: [1-9]" "$WORK/cache/log.txt" || fail cache "no cache hits"
+fi
+
+# bins: same results and every input record exactly once in one of the bins
+if run bins "$WORK/reads.fa" --bin_output; then
+	check bins ref
+	records < "$WORK/reads.fa" > "$WORK/bins/records.in"
+	zcat "$WORK"/bins/reads.fa.bin.*.fa.gz | records > "$WORK/bins/records.out"
+	cmp -s "$WORK/bins/records.in" "$WORK/bins/records.out" || fail bins "bin records differ from the input records"
+	zcat "$WORK/bins/reads.fa.bin.unclassified.fa.gz" | grep -q "^>short1 too short" || fail bins "short reads are not binned as unclassified"
+fi
+
+# early stop: the first 10000 nt of the genomes with 8% substitutions are classified from part of their
+# windows (calibration of the sequential test); the best labels are the ones of all windows
+zcat "$GENOMES" | awk 'BEGIN { srand(1); split("A C G T", b, " ") }
+	/^>/ { print; n = 0; next }
+	n < 10000 {
+		s = "";
+		for (i = 1; i <= length($0) && n + i <= 10000; i++){ c = substr($0, i, 1); if (rand() < 0.08) c = b[int(rand()*4)+1]; s = s c }
+		print s; n += length($0);
+	}' > "$WORK/mutated.fa"
+if run mutated "$WORK/mutated.fa" && run early_stop "$WORK/mutated.fa" --early_stop_windows 20; then
+	grep -q "Early stop: [1-9][0-9]* of" "$WORK/early_stop/log.txt" || fail early_stop "no sequence stopped early"
+	awk -F'\t' 'FNR == NR { best[$1] = $10; next }
+		$10 != best[$1] { differ++ } $3 < $11 { stopped++ }
+		END { exit !(differ == 0 && stopped > 0) }' "$WORK/mutated/res.sorted" "$WORK/early_stop/res.sorted" \
+		&& echo "ok   early_stop" || fail early_stop "early stopped sequences have other best labels than with all windows"
+fi
+
+# long sequences split over several chunks vs. all windows in one chunk (--bin_output keeps them together)
+run long "$WORK/long.fa" && run long_nosplit "$WORK/long.fa" --bin_output && check long long_nosplit
+
+# C API: the example program of libedenseq reports the strand, windows, maximum and best labels of ref
+# (the library logs to stdout, result lines have a strand; sequences shorter than a window are not in ref)
+EXAMPLE=$ROOT/src/examples/classify_example
+if [ -x "$EXAMPLE" ]; then
+	dir=$WORK/capi
+	rm -rf "$dir"; mkdir -p "$dir"; cp "$BED" "$dir/"
+	[ -f "$WORK/ref/test.small.bed.bhi" ] && cp "$WORK/ref/test.small.bed.bhi" "$dir/"
+	if (cd "$dir" && "$EXAMPLE" "$WORK/reads.fa" --index_seqs "$GENOMES" --index_bed "$dir/test.small.bed" $OPTS -y "$dir/" > "$dir/res.tab" 2> "$dir/log.txt"); then
+		awk -F'\t' -v OFS='\t' 'NF >= 4 && $2 ~ /^[-+.]$/ && $3 > 0 { n = split($5, l, ","); for (i = 2; i <= n; i++) for (j = i; j > 1 && l[j-1] > l[j]; j--){ t = l[j]; l[j] = l[j-1]; l[j-1] = t; }
+			s = ""; for (i = 1; i <= n; i++) s = s l[i] ","; print $1, $2, $3, $4, (n ? s : "") }' "$dir/res.tab" | sort > "$dir/res.sorted"
+		awk -F'\t' -v OFS='\t' '{ print $1, $2, $3, $7, $10 }' "$WORK/ref/res.named" | sort > "$dir/res.expected"
+		cmp -s "$dir/res.expected" "$dir/res.sorted" && echo "ok   capi" || fail capi "C API results differ from ref (diff $dir/res.expected $dir/res.sorted)"
+	else
+		fail capi "classify_example failed, see $dir/log.txt"
+	fi
+else
+	echo "skip capi: build the example with make examples"
+fi
+
+# SERVE protocol: the test client gets the same result lines
+if [ -x "$CLIENT" ]; then
+	dir=$WORK/serve
+	rm -rf "$dir"; mkdir -p "$dir"; cp "$BED" "$dir/"
+	(cd "$dir" && exec "$BIN" -a SERVE --serve_socket "$dir/edenseq.sock" --index_seqs "$GENOMES" --index_bed "$dir/test.small.bed" $OPTS -y "$dir/" > "$dir/log.txt" 2>&1) &
+	server=$!
+	i=0
+	while [ ! -S "$dir/edenseq.sock" ] && [ $i -lt 300 ] && kill -0 $server 2>/dev/null; do
+		sleep 1; i=$((i+1))
+	done
+	if [ -S "$dir/edenseq.sock" ] && "$CLIENT" "$dir/edenseq.sock" "$WORK/reads.fa" 500 > "$dir/res.tab"; then
+		grep -v "^#" "$dir/res.tab" | sort > "$dir/res.sorted"
+		check serve ref
+	else
+		fail serve "no answer from server, see $dir/log.txt"
+	fi
+	kill $server 2>/dev/null
+	wait $server 2>/dev/null
+else
+	echo "skip serve: build the test client with make examples"
+fi
+
+if [ $FAILED -ne 0 ]; then
+	echo "regression checks FAILED"
+	exit 1
+fi
+echo "all regression checks passed"
@@ -73,7 +73,7 @@ Data::BEDdataP Data::LoadBEDfile(string filename){
 }
 
 
-void Data::GetNextFastaSeq(istream& in,string& currSeq, string& header) {
+void Data::GetNextFastaSeq(istream& in,string& currSeq, string& header, string* oRawHeader, string* oRawSeq) {
 
 	in >> std::ws;
 
@@ -87,6 +87,10 @@ void Data::GetNextFastaSeq(istream& in,string& currSeq, string& header) {
 		getline(in, currSeq,'>');
 		currSeq.erase(std::remove(currSeq.begin(), currSeq.end(), '\n'),currSeq.end());
 		currSeq.erase(std::remove(currSeq.begin(), currSeq.end(), ' '),currSeq.end());
+		if (oRawHeader != nullptr)
+			*oRawHeader = header;
+		if (oRawSeq != nullptr)
+			*oRawSeq = currSeq;
 		std::transform(currSeq.begin(), currSeq.end(), currSeq.begin(), ::toupper);
 
 		//string seq = currSeq.substr(mpParameters->mSeqClip,currSeq.size()-(2*mpParameters->mSeqClip));
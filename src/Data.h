@@ -43,7 +43,8 @@ public:
 	//bool SetGraphFromSeq2(GraphClass& oG, string& currSeq, unsigned& pos, bool& lastGr, string& seq);
 	//bool SetGraphFromSeq(string& seq, GraphClass& oG);
 	void GetRevComplSeq(string& in_seq,string& out_seq);
-	void GetNextFastaSeq(istream& in,string& currSeq, string& header);
+	// header is the name up to the first space and currSeq is uppercased, oRawHeader/oRawSeq get them as in the file
+	void GetNextFastaSeq(istream& in,string& currSeq, string& header, string* oRawHeader = nullptr, string* oRawSeq = nullptr);
 	void GetNextStringSeq(istream& in,string& currSeq);
 	void LoadStringList(string aFileName, vector<string>& oList, uint numTokens);
 
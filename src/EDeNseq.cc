@@ -12,6 +12,7 @@
 #include "SeqClusterManager.h"
 #include "SeqClassifyManager.h"
 #include "TestManager.h"
+#include "SeqServer.h"
 
 using namespace std;
 
@@ -42,6 +43,26 @@ public:
 			seq_classify_manager.Exec();
 		}
 		break;
+		case PUBLISH_INDEX:{
+			SeqClassifyManager seq_classify_manager(&mParameters, &mData);
+			seq_classify_manager.PublishIndex();
+		}
+		break;
+		case MERGE_INDEX:{
+			SeqClassifyManager seq_classify_manager(&mParameters, &mData);
+			seq_classify_manager.MergeIndex();
+		}
+		break;
+		case UPDATE_INDEX:{
+			SeqClassifyManager seq_classify_manager(&mParameters, &mData);
+			seq_classify_manager.UpdateIndex();
+		}
+		break;
+		case SERVE:{
+			SeqServer seq_server(&mParameters, &mData);
+			seq_server.Exec();
+		}
+		break;
 		case CLUSTER:{
 			SeqClusterManager cluster_manager(&mParameters, &mData);
 			cluster_manager.Exec();
@@ -0,0 +1,481 @@
+/*
+ * FlatIndex.cc
+ *
+ *      Author: heyne
+ */
+
+#include "FlatIndex.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+// all arrays in the blob start at 8 byte boundaries
+inline uint64_t align8(uint64_t off) { return (off + 7) & ~((uint64_t)7); }
+
+// the flat blob starts at a (huge) page boundary within a shared memory segment
+const uint64_t SHM_BLOB_ALIGN = 2097152;
+
+FlatIndex::FlatIndex():
+mBase(nullptr), mHeader(nullptr), mPool(nullptr)
+{
+}
+
+uint64_t FlatIndex::ComputeLayout(const vector<binListT>& bins, unsigned hashBitSize, vector<sectionS>& sections, uint64_t& poolOffset, uint64_t& poolEntries){
+
+	uint64_t off = align8(sizeof(headerS));
+	off = align8(off + bins.size()*sizeof(sectionS));
+
+	sections.resize(bins.size());
+	poolEntries = 0;
+	for (unsigned hf = 0; hf < bins.size(); hf++){
+		sectionS& s = sections[hf];
+		s.numKeys = bins[hf].size();
+
+		// roughly 1-2 keys per bucket, at least one bit so that shift is always < 32
+		unsigned bits = 1;
+		while (bits < hashBitSize && ((uint64_t)1 << (bits+1)) < s.numKeys)
+			bits++;
+		s.dirBits = bits;
+		s.shift = hashBitSize - bits;
+
+		s.dirOffset = off;
+		off = align8(off + (((uint64_t)1 << bits) + 1) * sizeof(unsigned));
+		s.keysOffset = off;
+		off = align8(off + s.numKeys * sizeof(unsigned));
+		s.refsOffset = off;
+		off = align8(off + s.numKeys * sizeof(unsigned));
+
+		for (binListT::const_iterator it = bins[hf].begin(); it != bins[hf].end(); ++it)
+			poolEntries += it->second[0] + 1;
+	}
+
+	if (poolEntries > std::numeric_limits<unsigned>::max())
+		throw range_error("ERROR FlatIndex: too many bin entries for 32bit references (" + std::to_string(poolEntries) + ")");
+
+	poolOffset = off;
+	off = align8(off + poolEntries * sizeof(binKeyTy));
+	return off;
+}
+
+uint64_t FlatIndex::GetBlobSize(const vector<binListT>& bins, unsigned hashBitSize){
+	vector<sectionS> sections;
+	uint64_t poolOffset, poolEntries;
+	return ComputeLayout(bins, hashBitSize, sections, poolOffset, poolEntries);
+}
+
+void FlatIndex::WriteBlob(char* dest, vector<binListT>& bins, unsigned hashBitSize, unsigned histogramSize){
+
+	vector<sectionS> sections;
+	uint64_t poolOffset, poolEntries;
+	uint64_t totalSize = ComputeLayout(bins, hashBitSize, sections, poolOffset, poolEntries);
+
+	headerS* header = reinterpret_cast<headerS*>(dest);
+	header->magic            = FLAT_MAGIC;
+	header->version          = FLAT_VERSION;
+	header->numHashFunctions = bins.size();
+	header->hashBitSize      = hashBitSize;
+	header->histogramSize    = histogramSize;
+	header->poolOffset       = poolOffset;
+	header->poolEntries      = poolEntries;
+	header->totalSize        = totalSize;
+
+	memcpy(dest + align8(sizeof(headerS)), sections.data(), sections.size()*sizeof(sectionS));
+
+	binKeyTy* pool = reinterpret_cast<binKeyTy*>(dest + poolOffset);
+	uint64_t poolPos = 0;
+
+	for (unsigned hf = 0; hf < bins.size(); hf++){
+		sectionS& s = sections[hf];
+		sort(bins[hf].begin(), bins[hf].end(), [](const binEntryT& a, const binEntryT& b){ return a.first < b.first; });
+
+		unsigned* dir  = reinterpret_cast<unsigned*>(dest + s.dirOffset);
+		unsigned* keys = reinterpret_cast<unsigned*>(dest + s.keysOffset);
+		unsigned* refs = reinterpret_cast<unsigned*>(dest + s.refsOffset);
+
+		uint64_t numBuckets = (uint64_t)1 << s.dirBits;
+		uint64_t bucket = 0;
+		for (uint64_t i = 0; i < s.numKeys; i++){
+			const binEntryT& e = bins[hf][i];
+			uint64_t b = e.first >> s.shift;
+			while (bucket <= b && bucket < numBuckets){
+				dir[bucket++] = i;
+			}
+			keys[i] = e.first;
+			refs[i] = poolPos;
+			memcpy(pool + poolPos, e.second, (e.second[0]+1)*sizeof(binKeyTy));
+			poolPos += e.second[0]+1;
+		}
+		while (bucket <= numBuckets){
+			dir[bucket++] = s.numKeys;
+		}
+	}
+}
+
+void FlatIndex::Attach(const char* base){
+
+	const headerS* header = reinterpret_cast<const headerS*>(base);
+	if (header->magic != FLAT_MAGIC || header->version != FLAT_VERSION)
+		throw range_error("ERROR FlatIndex: blob has wrong magic number or version!");
+
+	mBase   = base;
+	mHeader = header;
+	mPool   = reinterpret_cast<const binKeyTy*>(base + header->poolOffset);
+
+	const sectionS* sections = reinterpret_cast<const sectionS*>(base + align8(sizeof(headerS)));
+	mSections.resize(header->numHashFunctions);
+	for (unsigned hf = 0; hf < header->numHashFunctions; hf++){
+		sectionViewS& v = mSections[hf];
+		v.numKeys    = sections[hf].numKeys;
+		v.numBuckets = (uint64_t)1 << sections[hf].dirBits;
+		v.shift      = sections[hf].shift;
+		v.dir        = reinterpret_cast<const unsigned*>(base + sections[hf].dirOffset);
+		v.keys       = reinterpret_cast<const unsigned*>(base + sections[hf].keysOffset);
+		v.refs       = reinterpret_cast<const unsigned*>(base + sections[hf].refsOffset);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+//	CLASS QUOTIENTKEYTABLE
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+QuotientKeyTable::QuotientKeyTable():
+mRemainderBits(0), mRemainderMask(0), mNumBuckets(0)
+{
+}
+
+void QuotientKeyTable::Build(const vector<entryT>& entries, unsigned hashBitSize){
+
+	// about 4 keys per bucket, but remainders have to fit into 16 bits
+	unsigned quotientBits = 0;
+	while (quotientBits < hashBitSize && ((uint64_t)4 << quotientBits) < entries.size())
+		quotientBits++;
+	if (hashBitSize > 16)
+		quotientBits = std::max(quotientBits, hashBitSize - 16);
+
+	mRemainderBits = hashBitSize - quotientBits;
+	mRemainderMask = (1U << mRemainderBits) - 1;
+	mNumBuckets = (uint64_t)1 << quotientBits;
+
+	mDir.assign(mNumBuckets+1, 0);
+	mRemainders.resize(entries.size());
+	mValues.resize(entries.size());
+	for (uint64_t i = 0; i < entries.size(); i++){
+		uint64_t b = entries[i].first >> mRemainderBits;
+		if (b >= mNumBuckets)
+			throw range_error("ERROR key exceeds hash bit size in QuotientKeyTable!");
+		if (i > 0 && entries[i].first <= entries[i-1].first)
+			throw range_error("ERROR keys for QuotientKeyTable are not sorted!");
+		mDir[b+1]++;
+		mRemainders[i] = entries[i].first & mRemainderMask;
+		mValues[i] = entries[i].second;
+	}
+	for (uint64_t b = 0; b < mNumBuckets; b++)
+		mDir[b+1] += mDir[b];
+}
+
+uint64_t QuotientKeyTable::GetMemory() const {
+	return mDir.size()*sizeof(unsigned) + mRemainders.size()*sizeof(uint16_t) + mValues.size()*sizeof(unsigned);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+//	CLASS INLINEBINTABLE
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+InlineBinTable::InlineBinTable():
+mMask(0), mShift(64), mNumKeys(0)
+{
+}
+
+void InlineBinTable::Init(uint64_t numKeys){
+
+	// load factor at most 0.7
+	unsigned bits = 4;
+	while (((uint64_t)1 << bits)*7 < numKeys*10)
+		bits++;
+	mShift = 64 - bits;
+	mMask = ((uint64_t)1 << bits) - 1;
+	mNumKeys = 0;
+
+	slotS empty;
+	memset(&empty, 0, sizeof(slotS));
+	mSlots.assign((uint64_t)1 << bits, empty);
+	mOverflow.clear();
+}
+
+void InlineBinTable::Insert(unsigned key, const binKeyTy* bin){
+
+	if (key == 0)
+		throw range_error("ERROR key 0 cannot be stored in InlineBinTable!");
+	if ((mNumKeys+1)*10 > mSlots.size()*9)
+		throw range_error("ERROR InlineBinTable is full!");
+
+	uint64_t i = Slot(key);
+	while (mSlots[i].key != 0 && mSlots[i].key != key)
+		i = (i + 1) & mMask;
+	slotS& slot = mSlots[i];
+	if (slot.key == 0)
+		mNumKeys++;
+
+	slot.key = key;
+	slot.size = bin[0];
+	if (bin[0] <= INLINE_LABELS){
+		memcpy(slot.labels, &bin[1], bin[0]*sizeof(binKeyTy));
+	} else {
+		uint64_t offset = mOverflow.size();
+		memcpy(slot.labels, &offset, sizeof(uint64_t));
+		mOverflow.insert(mOverflow.end(), &bin[1], &bin[1]+bin[0]);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+//	CLASS SHAREDINDEXSEGMENT
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+SharedIndexSegment::SharedIndexSegment():
+mData(nullptr), mSize(0), mHeaderMap(nullptr), mHeader(nullptr), mCounted(false), mFd(-1)
+{
+}
+
+SharedIndexSegment::~SharedIndexSegment(){
+	Detach();
+}
+
+string SharedIndexSegment::NormalizeName(const string& name){
+	if (name.size() == 0 || name.find('/',1) != string::npos)
+		throw range_error("ERROR shared memory name must be a plain name without '/': " + name);
+	if (name[0] == '/')
+		return name;
+	return "/" + name;
+}
+
+bool SharedIndexSegment::IsSameSegment(int fd, const string& name){
+	int fdName = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fdName == -1)
+		return false;
+	struct stat st, stName;
+	bool same = (fstat(fd, &st) == 0 && fstat(fdName, &stName) == 0 && st.st_dev == stName.st_dev && st.st_ino == stName.st_ino);
+	close(fdName);
+	return same;
+}
+
+void SharedIndexSegment::Publish(const string& name, const string& meta, vector<FlatIndex::binListT>& bins, unsigned hashBitSize, unsigned histogramSize, bool hugePages){
+
+	mName = NormalizeName(name);
+
+	int fd = shm_open(mName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+	if (fd == -1 && errno == EEXIST){
+		// an existing segment is only replaced if its publisher died while building it or
+		// if it was retired and all processes that were still attached have finished
+		int fdOld = shm_open(mName.c_str(), O_RDONLY, 0);
+		bool stale = false;
+		if (fdOld != -1){
+			shmHeaderS old;
+			if (pread(fdOld, &old, sizeof(shmHeaderS), 0) == (ssize_t)sizeof(shmHeaderS) && old.magic == SHM_MAGIC){
+				stale = (old.state == SHM_BUILDING && kill(old.publisherPid, 0) == -1 && errno == ESRCH)
+						|| (old.state == SHM_RETIRED && flock(fdOld, LOCK_EX | LOCK_NB) == 0);
+			}
+			close(fdOld);
+		}
+		if (!stale)
+			throw range_error("ERROR shared index " + mName + " is already published! Remove it first with --shm_remove.");
+		cout << "Remove stale shared index segment " << mName << endl;
+		shm_unlink(mName.c_str());
+		fd = shm_open(mName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+	}
+	if (fd == -1)
+		throw range_error("ERROR cannot create shared memory segment " + mName + ": " + strerror(errno));
+
+	// meta is 32 byte aligned as it holds the blocks of the key filters
+	uint64_t metaOffset = (sizeof(shmHeaderS) + 31) & ~((uint64_t)31);
+	uint64_t flatOffset = ((metaOffset + meta.size()) / SHM_BLOB_ALIGN + 1) * SHM_BLOB_ALIGN;
+	uint64_t flatSize   = FlatIndex::GetBlobSize(bins, hashBitSize);
+	mSize = flatOffset + flatSize;
+
+	if (ftruncate(fd, mSize) == -1){
+		close(fd);
+		shm_unlink(mName.c_str());
+		throw range_error("ERROR cannot resize shared memory segment " + mName + " to " + std::to_string(mSize) + " bytes: " + strerror(errno));
+	}
+
+	mData = mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mData == MAP_FAILED){
+		mData = nullptr;
+		shm_unlink(mName.c_str());
+		throw range_error("ERROR cannot map shared memory segment " + mName + ": " + strerror(errno));
+	}
+
+	bool usesHugePages = false;
+	if (hugePages){
+#ifdef MADV_HUGEPAGE
+		usesHugePages = (madvise(mData, mSize, MADV_HUGEPAGE) == 0);
+#endif
+		if (!usesHugePages)
+			cout << "Huge pages not available for shared memory (check /sys/kernel/mm/transparent_hugepage/shmem_enabled), use normal pages" << endl;
+	}
+
+	char* base = static_cast<char*>(mData);
+	mHeader = new (base) shmHeaderS;
+	mHeader->magic        = SHM_MAGIC;
+	mHeader->state        = SHM_BUILDING;
+	mHeader->refCount     = 0;
+	mHeader->publisherPid = getpid();
+	mHeader->hugePages    = usesHugePages;
+	mHeader->segmentSize  = mSize;
+	mHeader->metaOffset   = metaOffset;
+	mHeader->metaSize     = meta.size();
+	mHeader->flatOffset   = flatOffset;
+	mHeader->flatSize     = flatSize;
+
+	memcpy(base + metaOffset, meta.data(), meta.size());
+	FlatIndex::WriteBlob(base + flatOffset, bins, hashBitSize, histogramSize);
+
+	mHeader->state = SHM_READY;
+	cout << "Published shared index " << mName << " (" << mSize/1048576 << " MB" << (usesHugePages ? ", huge pages" : "") << ")" << endl;
+}
+
+void SharedIndexSegment::Attach(const string& name){
+
+	mName = NormalizeName(name);
+
+	// we need write access only for the reference counter, fall back to pure read-only access
+	bool writable = true;
+	int fd = shm_open(mName.c_str(), O_RDWR, 0);
+	if (fd == -1 && errno == EACCES){
+		writable = false;
+		fd = shm_open(mName.c_str(), O_RDONLY, 0);
+	}
+	if (fd == -1)
+		throw range_error("ERROR cannot open shared index " + mName + ": " + strerror(errno) + "\nPublish it first with -a PUBLISH_INDEX.");
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || (uint64_t)st.st_size < sizeof(shmHeaderS)){
+		close(fd);
+		throw range_error("ERROR shared index " + mName + " is empty or not accessible!");
+	}
+	mSize = st.st_size;
+
+	mData = mmap(nullptr, mSize, PROT_READ, MAP_SHARED, fd, 0);
+	if (mData != MAP_FAILED && writable){
+		mHeaderMap = mmap(nullptr, sizeof(shmHeaderS), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (mHeaderMap == MAP_FAILED)
+			mHeaderMap = nullptr;
+	}
+	if (mData == MAP_FAILED){
+		mData = nullptr;
+		close(fd);
+		throw range_error("ERROR cannot map shared index " + mName + ": " + strerror(errno));
+	}
+	// the descriptor is kept open for the shared lock until Detach
+	mFd = fd;
+
+	mHeader = static_cast<shmHeaderS*>(mHeaderMap != nullptr ? mHeaderMap : mData);
+	if (mHeader->magic != SHM_MAGIC || mHeader->segmentSize != mSize)
+		throw range_error("ERROR shared memory segment " + mName + " does not contain an EDeNseq index!");
+
+	// the first process that attaches resets counts left by crashed processes,
+	// the state is checked after locking as Remove retires segments under an exclusive lock
+	if (mHeaderMap != nullptr && flock(mFd, LOCK_EX | LOCK_NB) == 0)
+		mHeader->refCount = 0;
+	if (flock(mFd, LOCK_SH) == -1)
+		throw range_error("ERROR cannot lock shared index " + mName + ": " + strerror(errno));
+	if (mHeader->state != SHM_READY)
+		throw range_error("ERROR shared index " + mName + " is not ready (still building or retired)!");
+
+	if (mHeaderMap != nullptr){
+		mHeader->refCount++;
+		mCounted = true;
+	}
+	cout << "Attached shared index " << mName << " (" << mSize/1048576 << " MB, " << GetRefCount() << " attached processes)" << endl;
+}
+
+void SharedIndexSegment::Detach(){
+	if (mCounted){
+		mHeader->refCount--;
+		mCounted = false;
+	}
+	// the last process of a retired segment (that still has its name) removes the name
+	if (mFd != -1 && mHeader != nullptr && mHeader->state == SHM_RETIRED
+			&& flock(mFd, LOCK_EX | LOCK_NB) == 0 && IsSameSegment(mFd, mName)){
+		shm_unlink(mName.c_str());
+		cout << "Removed retired shared index " << mName << endl;
+	}
+	if (mHeaderMap != nullptr)
+		munmap(mHeaderMap, sizeof(shmHeaderS));
+	if (mData != nullptr)
+		munmap(mData, mSize);
+	if (mFd != -1)
+		close(mFd);
+	mHeaderMap = nullptr;
+	mData = nullptr;
+	mHeader = nullptr;
+	mFd = -1;
+}
+
+void SharedIndexSegment::Remove(const string& name, bool force){
+
+	string shmName = NormalizeName(name);
+
+	int fd = shm_open(shmName.c_str(), O_RDWR, 0);
+	if (fd == -1)
+		throw range_error("ERROR cannot open shared index " + shmName + ": " + strerror(errno));
+
+	// no other process holds a shared lock if the exclusive lock is granted
+	bool inUse = (flock(fd, LOCK_EX | LOCK_NB) == -1);
+	void* hdr = mmap(nullptr, sizeof(shmHeaderS), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (hdr != MAP_FAILED){
+		shmHeaderS* header = static_cast<shmHeaderS*>(hdr);
+		if (header->magic == SHM_MAGIC){
+			if (!inUse && header->refCount > 0){
+				cout << "Reclaim " << header->refCount << " attachments of processes that did not detach (crashed)" << endl;
+				header->refCount = 0;
+			}
+			header->state = SHM_RETIRED;
+			if (inUse && !force){
+				cout << "Shared index " << shmName << " is still attached by " << header->refCount << " processes; it is retired and the last of them removes it (--shm_force removes it now)" << endl;
+				munmap(hdr, sizeof(shmHeaderS));
+				close(fd);
+				return;
+			}
+			if (inUse)
+				cout << "Shared index " << shmName << " still attached by " << header->refCount << " processes; memory is released after they finished" << endl;
+		}
+		munmap(hdr, sizeof(shmHeaderS));
+	}
+	close(fd);
+
+	// removing the name is safe, the kernel keeps the memory until the last mapping is gone
+	if (shm_unlink(shmName.c_str()) == -1)
+		throw range_error("ERROR cannot remove shared index " + shmName + ": " + strerror(errno));
+	cout << "Removed shared index " << shmName << endl;
+}
+
+string SharedIndexSegment::GetMeta() const {
+	return string(GetMetaData(), mHeader->metaSize);
+}
+
+const char* SharedIndexSegment::GetMetaData() const {
+	return static_cast<const char*>(mData) + mHeader->metaOffset;
+}
+
+uint64_t SharedIndexSegment::GetMetaSize() const {
+	return mHeader->metaSize;
+}
+
+const char* SharedIndexSegment::GetFlatBlob() const {
+	return static_cast<const char*>(mData) + mHeader->flatOffset;
+}
+
+unsigned SharedIndexSegment::GetRefCount() const {
+	return mHeader->refCount;
+}
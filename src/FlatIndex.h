@@ -0,0 +1,290 @@
+/* -*- mode:c++ -*- */
+/*
+ * FlatIndex.h
+ *
+ * Frozen (read-only) representation of a HistogramIndex. All references
+ * inside the blob are offsets, so the very same bytes can be used from the
+ * heap or from a shared memory segment that is mapped at any address.
+ */
+
+#ifndef FLAT_INDEX_H
+#define FLAT_INDEX_H
+
+#include "Utility.h"
+
+using namespace std;
+
+class FlatIndex {
+
+public:
+
+	typedef uint16_t binKeyTy;
+
+	static const uint64_t FLAT_MAGIC   = 0x5844494e65446545ULL; // "EDeNeIDX"
+	static const unsigned FLAT_VERSION = 1;
+
+	// blob layout:
+	//   headerS
+	//   sectionS[numHashFunctions]
+	//   per hash function: dir[numBuckets+1] (unsigned), keys[numKeys] (unsigned), refs[numKeys] (unsigned)
+	//   pool: all bins as [len,label_1,..,label_len] (binKeyTy), refs point into the pool
+	struct headerS {
+		uint64_t magic;
+		unsigned version;
+		unsigned numHashFunctions;
+		unsigned hashBitSize;
+		unsigned histogramSize;
+		uint64_t poolOffset;
+		uint64_t poolEntries;
+		uint64_t totalSize;
+	};
+
+	// one section per hash function, keys are sorted and bucketed by their
+	// upper dirBits bits, i.e. keys of bucket b are keys[dir[b]..dir[b+1]-1]
+	struct sectionS {
+		uint64_t numKeys;
+		unsigned dirBits;
+		unsigned shift;
+		uint64_t dirOffset;
+		uint64_t keysOffset;
+		uint64_t refsOffset;
+	};
+
+	// input for building a blob: per hash function all (key,bin) pairs,
+	// bins use the HistogramIndex format, i.e. bin[0] is the number of labels
+	typedef pair<unsigned,const binKeyTy*> binEntryT;
+	typedef vector<binEntryT> binListT;
+
+	FlatIndex();
+
+	static uint64_t		GetBlobSize(const vector<binListT>& bins, unsigned hashBitSize);
+	static void				WriteBlob(char* dest, vector<binListT>& bins, unsigned hashBitSize, unsigned histogramSize);
+
+	void						Attach(const char* base);
+	bool						IsAttached() const { return mBase != nullptr; };
+	const headerS&			GetHeader() const { return *mHeader; };
+	uint64_t					GetNumKeys(unsigned hf) const { return mSections[hf].numKeys; };
+	inline void Prefetch(unsigned hf, unsigned key) const {
+		const sectionViewS& s = mSections[hf];
+		uint64_t b = key >> s.shift;
+		if (b < s.numBuckets)
+			__builtin_prefetch(&s.dir[b]);
+	};
+
+	// returns the bin for key in sub index hf (bin[0]=number of labels) or nullptr
+	inline const binKeyTy* Find(unsigned hf, unsigned key) const {
+		const sectionViewS& s = mSections[hf];
+		uint64_t b = key >> s.shift;
+		if (b >= s.numBuckets)
+			return nullptr;
+		for (unsigned i = s.dir[b]; i < s.dir[b+1]; ++i){
+			if (s.keys[i] == key)
+				return mPool + s.refs[i];
+			if (s.keys[i] > key)
+				break;
+		}
+		return nullptr;
+	};
+
+private:
+
+	struct sectionViewS {
+		uint64_t numKeys;
+		uint64_t numBuckets;
+		unsigned shift;
+		const unsigned* dir;
+		const unsigned* keys;
+		const unsigned* refs;
+	};
+
+	const char*				mBase;
+	const headerS*			mHeader;
+	const binKeyTy*		mPool;
+	vector<sectionViewS>	mSections;
+
+	static uint64_t		ComputeLayout(const vector<binListT>& bins, unsigned hashBitSize, vector<sectionS>& sections, uint64_t& poolOffset, uint64_t& poolEntries);
+};
+
+
+//------------------------------------------------------------------------------------------------------------------------
+/// Read-only map of hashBitSize-bit keys to 32 bit values. A key is split into a quotient
+/// (its upper bits, implicit by the bucket) and a remainder of at most 16 bits, only the
+/// remainder is stored. Remainders of a bucket are sorted and scanned linearly.
+class QuotientKeyTable {
+
+public:
+
+	typedef pair<unsigned,unsigned> entryT;
+
+	QuotientKeyTable();
+
+	// entries have to be sorted by key, keys must not exceed hashBitSize bits
+	void						Build(const vector<entryT>& entries, unsigned hashBitSize);
+
+	inline bool Find(unsigned key, unsigned& value) const {
+		uint64_t b = key >> mRemainderBits;
+		if (b >= mNumBuckets)
+			return false;
+		uint16_t rem = key & mRemainderMask;
+		for (unsigned i = mDir[b]; i < mDir[b+1]; ++i){
+			if (mRemainders[i] == rem){
+				value = mValues[i];
+				return true;
+			}
+			if (mRemainders[i] > rem)
+				break;
+		}
+		return false;
+	};
+
+	inline void Prefetch(unsigned key) const {
+		uint64_t b = key >> mRemainderBits;
+		if (b < mNumBuckets)
+			__builtin_prefetch(&mDir[b]);
+	};
+
+	uint64_t					GetNumKeys() const { return mValues.size(); };
+	unsigned					GetRemainderBits() const { return mRemainderBits; };
+	uint64_t					GetMemory() const;
+	const vector<unsigned>&	GetValues() const { return mValues; };
+
+private:
+	unsigned				mRemainderBits;
+	unsigned				mRemainderMask;
+	uint64_t				mNumBuckets;
+	vector<unsigned>	mDir;
+	vector<uint16_t>	mRemainders;
+	vector<unsigned>	mValues;
+};
+
+
+//------------------------------------------------------------------------------------------------------------------------
+/// Open addressing (linear probing) map of keys to bins. A slot of 16 bytes holds the key, the
+/// number of labels and up to INLINE_LABELS labels, larger bins are stored in an overflow
+/// array and the slot holds their offset. Key 0 marks empty slots.
+class InlineBinTable {
+
+public:
+
+	typedef uint16_t binKeyTy;
+
+	static const unsigned INLINE_LABELS = 5;
+
+	struct slotS {
+		unsigned key;
+		binKeyTy size;
+		binKeyTy labels[INLINE_LABELS];
+	};
+
+	InlineBinTable();
+
+	void						Init(uint64_t numKeys);
+	// bin has the HistogramIndex format, i.e. bin[0] is the number of labels, key must not be 0
+	void						Insert(unsigned key, const binKeyTy* bin);
+
+	// returns the labels of key and their number in size or nullptr
+	inline const binKeyTy* Find(unsigned key, unsigned& size) const {
+		for (uint64_t i = Slot(key);; i = (i + 1) & mMask){
+			const slotS& slot = mSlots[i];
+			if (slot.key == key){
+				size = slot.size;
+				return (size <= INLINE_LABELS) ? slot.labels : &mOverflow[GetOverflowOffset(slot)];
+			}
+			if (slot.key == 0)
+				return nullptr;
+		}
+	};
+
+	inline void Prefetch(unsigned key) const {
+		__builtin_prefetch(&mSlots[Slot(key)]);
+	};
+
+	uint64_t					GetNumKeys() const { return mNumKeys; };
+	uint64_t					GetNumSlots() const { return mSlots.size(); };
+	// number of labels in slot i, 0 for empty slots
+	unsigned					GetSlotSize(uint64_t i) const { return mSlots[i].key ? mSlots[i].size : 0; };
+	uint64_t					GetMemory() const { return mSlots.size()*sizeof(slotS) + mOverflow.size()*sizeof(binKeyTy); };
+
+private:
+	uint64_t					mMask;
+	unsigned					mShift;
+	uint64_t					mNumKeys;
+	vector<slotS>			mSlots;
+	vector<binKeyTy>		mOverflow;
+
+	inline uint64_t Slot(unsigned key) const {
+		return ((uint64_t)key * 0x9E3779B97F4A7C15ULL) >> mShift;
+	};
+	static inline uint64_t GetOverflowOffset(const slotS& slot) {
+		uint64_t offset;
+		memcpy(&offset, slot.labels, sizeof(uint64_t));
+		return offset;
+	};
+};
+
+
+//------------------------------------------------------------------------------------------------------------------------
+/// Named POSIX shared memory segment that holds a published index: a small
+/// header (state, reference count), the serialized index header/feature table
+/// as written to *.bhi files (followed by the key filters) and a FlatIndex blob.
+/// Attached processes hold a shared flock on the segment while they use it, the
+/// kernel releases it if a process crashes, i.e. the lock (not the count) tells
+/// whether a segment is still in use.
+class SharedIndexSegment {
+
+public:
+
+	static const uint64_t SHM_MAGIC = 0x4d48536e65446545ULL; // "EDeNeSHM"
+
+	enum segmentStateE {
+		SHM_BUILDING, SHM_READY, SHM_RETIRED
+	};
+
+	struct shmHeaderS {
+		uint64_t 				magic;
+		std::atomic_uint		state;
+		std::atomic_uint		refCount;
+		unsigned					publisherPid;
+		unsigned					hugePages;
+		uint64_t 				segmentSize;
+		uint64_t 				metaOffset;
+		uint64_t 				metaSize;
+		uint64_t 				flatOffset;
+		uint64_t 				flatSize;
+	};
+
+	SharedIndexSegment();
+	~SharedIndexSegment();
+
+	// creates segment <name>, meta holds the serialized index header, the flat blob is written by WriteBlob
+	void 			Publish(const string& name, const string& meta, vector<FlatIndex::binListT>& bins, unsigned hashBitSize, unsigned histogramSize, bool hugePages);
+	// maps an existing segment read-only and registers this process as user
+	void 			Attach(const string& name);
+	// the last process that detaches from a retired segment removes its name
+	void 			Detach();
+	// marks segment as retired and removes the name if no process is attached anymore (counts
+	// left by crashed processes are reclaimed), otherwise the last attached process removes it;
+	// forced: the name is removed at once, attached processes keep their mapping
+	static void	Remove(const string& name, bool force);
+
+	string		GetMeta() const;
+	const char*	GetMetaData() const;
+	uint64_t		GetMetaSize() const;
+	const char*	GetFlatBlob() const;
+	unsigned 	GetRefCount() const;
+
+private:
+	string 			mName;
+	void*				mData;
+	uint64_t			mSize;
+	void*				mHeaderMap;
+	shmHeaderS*		mHeader;
+	bool				mCounted;
+	int				mFd;
+
+	static string	NormalizeName(const string& name);
+	// true if fd and name still refer to the same segment (the name may have been published again)
+	static bool		IsSameSegment(int fd, const string& name);
+};
+
+#endif /* FLAT_INDEX_H */
@@ -324,6 +324,7 @@ void MinHashEncoder::worker_readFiles(unsigned numWorkers, unsigned chunkSizeFac
 			std::tr1::unordered_map<string, uint8_t> seq_names_seen;
 
 			unsigned pos = 0; // tracks the start pos of the next large window of currSeq
+			unsigned part = 0; // part of currSeq in the current chunk if it is split over several chunks
 			unsigned idx = 0; // set according to groupGraphsBy, grouping id for the inverse index of current seq window
 
 			bool valid_input = false; // set to false so that we get new seq in while further down directly
@@ -331,6 +332,14 @@ void MinHashEncoder::worker_readFiles(unsigned numWorkers, unsigned chunkSizeFac
 			string currFullSeq;
 			string currSeqName;
 
+			// --bin_output: the input record of currSeq and the records of sequences without windows
+			const bool keepRecords = myData->signatureAction==CLASSIFY && myData->keepRecords;
+			string rawHeader;
+			string rawSeq;
+			std::shared_ptr<const string> currRecord;
+			bool currHasInstances = false;
+			vector<std::shared_ptr<const string> > skippedRecords;
+
 			std::pair<Data::BEDdataIt,Data::BEDdataIt> annoEntries;
 			Data::BEDdataIt it; // iterator over all bed entries of current seq
 
@@ -341,15 +350,18 @@ void MinHashEncoder::worker_readFiles(unsigned numWorkers, unsigned chunkSizeFac
 				//	unsigned maxB = max((uint)1000,(uint)log2((double)mSignatureCounter)^2*chunkSizeFactor);
 				//	unsigned currBuff = maxB*3; //rand()%(maxB*4	 - maxB*2 + 1) + maxB; // curr chunk size
 				unsigned largeBuff = 100000 * chunkSizeFactor * rand()%(300000)+100000;
+				unsigned largeWin = largeBuff;
+				if (myData->signatureAction==CLASSIFY)
+					largeWin = CLASSIFY_LARGE_WINDOW;
 				unsigned currBases = 0;
 
 				// indicates that we have the last fragment from current seq,
 				// used to get all fragments from current seq into the same chunk
-				// to combine signatures in finisher
+				// to combine signatures in finisher, unless the sequence may be split (splitSeqs)
 				bool lastSeqGr = false;
 
 				ChunkP 		myChunkP = std::make_shared<ChunkT>();
-				while ( ((currBases<largeBuff) && !fin.eof()) || (myData->signatureAction==CLASSIFY && currBases>=largeBuff && lastSeqGr == false) ) {
+				while ( ((currBases<largeBuff) && !fin.eof()) || (myData->signatureAction==CLASSIFY && !myData->splitSeqs && currBases>=largeBuff && lastSeqGr == false) ) {
 
 					if (!valid_input) {
 						if  ( it == annoEntries.second ) {
@@ -357,9 +369,14 @@ void MinHashEncoder::worker_readFiles(unsigned numWorkers, unsigned chunkSizeFac
 
 							switch (myData->filetype) {
 							case FASTA:
-								mpData->GetNextFastaSeq(fin, currFullSeq, currSeqName);
+								if (keepRecords)
+									mpData->GetNextFastaSeq(fin, currFullSeq, currSeqName, &rawHeader, &rawSeq);
+								else
+									mpData->GetNextFastaSeq(fin, currFullSeq, currSeqName);
 								if (fin.eof() )
 									continue;
+								if (keepRecords)
+									currRecord = std::make_shared<const string>(">" + rawHeader + "\n" + rawSeq + "\n");
 								mSequenceCounter++;
 								if (myData->checkUniqueSeqNames && seq_names_seen.count(currSeqName) > 0) {
 									throw range_error("Sequence names are not unique in FASTA file! "+currSeqName);
@@ -374,6 +391,8 @@ void MinHashEncoder::worker_readFiles(unsigned numWorkers, unsigned chunkSizeFac
 									continue;
 								mSequenceCounter++;
 								currSeqName =  std::to_string(mSequenceCounter);
+								if (keepRecords)
+									currRecord = std::make_shared<const string>(">" + currSeqName + "\n" + currFullSeq + "\n");
 								break;
 							default:
 								throw range_error("ERROR Data::LoadData: file type not recognized: " + myData->filetype);
@@ -443,6 +462,8 @@ void MinHashEncoder::worker_readFiles(unsigned numWorkers, unsigned chunkSizeFac
 						}
 
 						pos = 0;
+						part = 0;
+						currHasInstances = false;
 						valid_input = true;
 
 					} // valid_input?
@@ -451,7 +472,7 @@ void MinHashEncoder::worker_readFiles(unsigned numWorkers, unsigned chunkSizeFac
 					InstanceT	myInstance;
 
 					// get next seq window
-					mpData->GetNextLargeWinFromSeq(currSeq, pos, lastSeqGr, myInstance.seq, largeBuff, mpParameters->mSeqWindow, mpParameters->mSeqShift);
+					mpData->GetNextLargeWinFromSeq(currSeq, pos, lastSeqGr, myInstance.seq, largeWin, mpParameters->mSeqWindow, mpParameters->mSeqShift);
 
 					// require here at least a seq of maximal feature span, we assume this later for feature generation
 					if (myInstance.seq.size() >= mpParameters->mRadius + mpParameters->mDistance + 1){
@@ -472,6 +493,8 @@ void MinHashEncoder::worker_readFiles(unsigned numWorkers, unsigned chunkSizeFac
 							myInstance.idx = idx;
 							myInstance.pos = pos;
 							myInstance.rc = false;
+							myInstance.part = part;
+							myInstance.record = currRecord;
 
 							myChunkP->push_back(myInstance);
 							mInstanceCounter++;
@@ -485,6 +508,8 @@ void MinHashEncoder::worker_readFiles(unsigned numWorkers, unsigned chunkSizeFac
 							myInstanceRC.idx = idx;
 							myInstanceRC.pos = pos;
 							myInstanceRC.rc = true;
+							myInstanceRC.part = part;
+							myInstanceRC.record = currRecord;
 							mpData->GetRevComplSeq(myInstance.seq,myInstanceRC.seq);
 
 							myChunkP->push_back(myInstanceRC);
@@ -492,8 +517,12 @@ void MinHashEncoder::worker_readFiles(unsigned numWorkers, unsigned chunkSizeFac
 							currBases += myInstanceRC.seq.size();
 
 						}
-					} else
+						currHasInstances = true;
+					} else {
+						if (keepRecords && !currHasInstances)
+							skippedRecords.push_back(currRecord);
 						valid_input = false;
+					}
 
 					if (lastSeqGr)
 						valid_input = false;
@@ -501,9 +530,20 @@ void MinHashEncoder::worker_readFiles(unsigned numWorkers, unsigned chunkSizeFac
 					//cout << "Gr: " << myChunkP->size() << " " << currBases<< " "<< pos << " " << currSeqName<<  " " << currSeq.size() << " " << lastSeqGr << endl;
 				} // while buffer not full or eof
 
+				if (skippedRecords.size() > 0){
+					SkippedSequences(myData, skippedRecords);
+					skippedRecords.clear();
+				}
 
 				if (myChunkP->size()==0)
 					continue;
+
+				// the current sequence continues in the next chunk, its parts are merged after the classification
+				if (myData->signatureAction==CLASSIFY && valid_input){
+					for (ChunkT::reverse_iterator r = myChunkP->rbegin(); r != myChunkP->rend() && r->idx == idx; ++r)
+						r->lastPart = false;
+					part++;
+				}
 				//cout << "Gr2: " << myChunkP->size() << " " << currBases << " "<< pos << " " << currSeqName<<  " " << currSeq.size() << " " << lastSeqGr << endl;
 				graph_queue[curr_q].push(myChunkP);
 
@@ -642,7 +682,9 @@ void MinHashEncoder::worker_Seq2Signature_SingleWin(int numWorkers, unsigned id)
 void MinHashEncoder::finisher_IndexUpdate(unsigned id, unsigned min, unsigned max){
 	ProgressBar progress_bar(1000);
 
-	while (!done){
+	// done is signaled as soon as the first hash functions are finished,
+	// so the remaining chunks of this thread have to be processed anyway
+	while (!done || !index_queue[id].empty()){
 
 		ChunkP myData;
 		bool succ=false;
@@ -651,7 +693,7 @@ void MinHashEncoder::finisher_IndexUpdate(unsigned id, unsigned min, unsigned ma
 			succ = index_queue[id].try_pop(myData);
 		}
 
-		if (!done && succ && myData->size()>0) {
+		if (succ && myData->size()>0) {
 
 			finishUpdate(myData,min,max);
 
@@ -1024,7 +1066,7 @@ void HistogramIndex::InitInverseIndex() {
 	for (unsigned k = 0; k < mpParameters->mNumHashFunctions; ++k){
 		mInverseIndex[k].max_load_factor(0.9);
 		mInverseIndex[k].set_resizing_parameters(0.0,0.9);
-		mInverseIndex[k].rehash(67108864);
+		// tables are sized by the caller, either from the key counts of an index file or from InitKeyEstimation
 		//mInverseIndex[k].rehash(268435456); // 2^28
 		//mInverseIndex[k].set_deleted_key(0);
 		//mInverseIndex[k].set_empty_key(0);
@@ -1038,6 +1080,92 @@ void HistogramIndex::InitInverseIndex() {
 		mMemPool_9[k] = new MemoryPool<newIndexBin_9,mMemPool_BlockSize>();
 		mMemPool_10[k] = new MemoryPool<newIndexBin_10,mMemPool_BlockSize>();
 	}
+
+	if (mUseLabelSets){
+		mSetIndex.resize(mpParameters->mNumHashFunctions);
+		for (unsigned k = 0; k < mpParameters->mNumHashFunctions; ++k){
+			mSetIndex[k].max_load_factor(0.9);
+			mSetIndex[k].set_resizing_parameters(0.0,0.9);
+		}
+	}
+}
+
+void HistogramIndex::InitKeyEstimation(uint64_t totalBases) {
+
+	const uint64_t minSampleBases = 4000000;
+	mTotalBases = totalBases;
+	mSampleTarget = min(totalBases, max(totalBases/32, minSampleBases));
+
+	mKeyEstimators.assign(mpParameters->mNumHashFunctions, HyperLogLog());
+	mSampleBases.assign(mpParameters->mNumHashFunctions, 0);
+	mHalfSampleBases.assign(mpParameters->mNumHashFunctions, 0);
+	mHalfSampleKeys.assign(mpParameters->mNumHashFunctions, 0);
+	mSampling.assign(mpParameters->mNumHashFunctions, 1);
+	mEstimatedKeys.assign(mpParameters->mNumHashFunctions, 0);
+
+	cout << "Estimate index size from a sample of " << mSampleTarget << " of " << mTotalBases << " nt" << endl;
+}
+
+void HistogramIndex::EstimateKeys(ChunkP& myData, unsigned& min, unsigned& max) {
+
+	// called by index update thread with hash function range min..max
+	if (mSampling.size() == 0 || !mSampling[min])
+		return;
+
+	for (ChunkT::iterator j=myData->begin(); j!= myData->end();j++) {
+		mSampleBases[min] += j->seq.size();
+		for (unsigned hf=min;hf<=max;hf++){
+			if (mUseSlidingWindowMinHash){
+				for (auto key : j->minHashes[hf])
+					mKeyEstimators[hf].Add(key);
+			} else
+				mKeyEstimators[hf].Add(j->sig[hf]);
+		}
+	}
+
+	// first point of the growth curve
+	if (mHalfSampleBases[min] == 0 && 2*mSampleBases[min] >= mSampleTarget){
+		mHalfSampleBases[min] = mSampleBases[min];
+		for (unsigned hf=min;hf<=max;hf++)
+			mHalfSampleKeys[hf] = mKeyEstimators[hf].Estimate();
+	}
+	if (mSampleBases[min] < mSampleTarget)
+		return;
+
+	// distinct keys grow sublinearly with redundant input (strains, plasmids, replicates), i.e. the sample
+	// is not scaled linearly; the exponent is at most 1 and a too small table still grows by rehashing
+	double scale = (double)mTotalBases/(double)mSampleBases[min];
+	double growth = (double)mSampleBases[min]/(double)mHalfSampleBases[min];
+	const double maxKeys = std::ldexp(1.0, mpParameters->mHashBitSize);
+	// the sample is complete for the whole range, not only for the hf that carries the counters
+	for (unsigned hf=min;hf<=max;hf++){
+		mSampling[hf] = false;
+		double keys = mKeyEstimators[hf].Estimate();
+		double exponent = 1.0;
+		if (growth > 1.0 && mHalfSampleKeys[hf] > 0 && keys > mHalfSampleKeys[hf])
+			exponent = std::min(1.0, std::log(keys/mHalfSampleKeys[hf])/std::log(growth));
+		else if (growth > 1.0)
+			exponent = 0.0;
+		double estimate = std::min(maxKeys, keys*std::pow(scale, exponent));
+		mEstimatedKeys[hf] = std::max((uint64_t)mInverseIndex[hf].size(), (uint64_t)estimate);
+		mInverseIndex[hf].rehash(mEstimatedKeys[hf]);
+	}
+}
+
+void HistogramIndex::PrintKeyEstimation() {
+
+	if (mEstimatedKeys.size() == 0)
+		return;
+
+	cout << "Estimated vs. actual keys per sub index:" << endl;
+	for (unsigned hf = 0; hf < mEstimatedKeys.size(); hf++){
+		// sample was never completed: the estimate covers the whole input
+		if (mSampling[hf])
+			mEstimatedKeys[hf] = mKeyEstimators[hf].Estimate();
+		cout << "sub index " << hf+1 << " : estimated " << mEstimatedKeys[hf] << " actual " << mInverseIndex[hf].size() << endl;
+	}
+	mKeyEstimators.clear();
+	mEstimatedKeys.clear();
 }
 
 void HistogramIndex::UpdateInverseIndex(const vector<unsigned>& aSignature, const unsigned& aIndex) {
@@ -1194,31 +1322,336 @@ void HistogramIndex::UpdateInverseIndex(const unsigned& key, const unsigned& aIn
 }
  */
 
-void HistogramIndex::ComputeHistogram(const vector<vector<unsigned>>& aSigArray, std::valarray<double>& hist, vector<unsigned>& emptyBins) {
+void HistogramIndex::ComputeHistogram(const vector<vector<unsigned>>& aSigArray, SparseHistogram& hist, vector<unsigned>& emptyBins, unsigned sigBegin, unsigned sigEnd) {
 
-	hist.resize(GetHistogramSize());
-	hist *= 0;
-	emptyBins.resize(aSigArray[0].size(),0);
+	sigEnd = std::min(sigEnd, (unsigned)aSigArray[0].size());
+	emptyBins.assign(sigEnd-sigBegin,0);
+
+	// keys rejected by the Bloom filter of their sub index are not looked up
+	const bool useFilter = mKeyFilters.size() != 0;
+
+	if (mUseHierarchy){
+		ComputeHistogramHierarchical(aSigArray, hist, emptyBins, sigBegin, sigEnd);
+		return;
+	}
+
+	if (mUseInlineBins){
+		for (unsigned hf = 0; hf < aSigArray.size(); ++hf) {
+			PrefetchGroup(hf, aSigArray[hf], sigBegin, sigEnd);
+			for (unsigned sig = sigBegin; sig < sigEnd; ++sig){
+				if ((sig - sigBegin) % PREFETCH_GROUP == 0)
+					PrefetchGroup(hf, aSigArray[hf], sig + PREFETCH_GROUP, sigEnd);
+				unsigned size;
+				const binKeyTy* labels = nullptr;
+				if (!useFilter || mKeyFilters[hf].MayContain(aSigArray[hf][sig]))
+					labels = mInlineTables[hf].Find(aSigArray[hf][sig], size);
+				if (labels != nullptr) {
+					for (unsigned i=0;i<size;++i){
+						hist.Add(labels[i]-1, 1);
+					}
+				} else {
+					emptyBins[sig - sigBegin]++;
+				}
+			}
+		}
+		return;
+	}
+
+	if (mFlatIndex.IsAttached()){
+		for (unsigned hf = 0; hf < aSigArray.size(); ++hf) {
+			PrefetchGroup(hf, aSigArray[hf], sigBegin, sigEnd);
+			for (unsigned sig = sigBegin; sig < sigEnd; ++sig){
+				if ((sig - sigBegin) % PREFETCH_GROUP == 0)
+					PrefetchGroup(hf, aSigArray[hf], sig + PREFETCH_GROUP, sigEnd);
+				const binKeyTy* myValue = nullptr;
+				if (!useFilter || mKeyFilters[hf].MayContain(aSigArray[hf][sig]))
+					myValue = mFlatIndex.Find(hf,aSigArray[hf][sig]);
+				if (myValue != nullptr) {
+					for (unsigned i=1;i<=myValue[0];++i){
+						hist.Add(myValue[i]-1, 1);
+					}
+				} else {
+					emptyBins[sig - sigBegin]++;
+				}
+			}
+		}
+		return;
+	}
+
+	if (mUseLabelSets){
+		// collect the label sets of all hits, each distinct set is then added once weighted by its number of hits
+		vector<unsigned> setIds;
+		setIds.reserve(aSigArray.size()*(sigEnd-sigBegin));
+		for (unsigned hf = 0; hf < aSigArray.size(); ++hf) {
+			PrefetchGroup(hf, aSigArray[hf], sigBegin, sigEnd);
+			for (unsigned sig = sigBegin; sig < sigEnd; ++sig){
+				if ((sig - sigBegin) % PREFETCH_GROUP == 0)
+					PrefetchGroup(hf, aSigArray[hf], sig + PREFETCH_GROUP, sigEnd);
+				if (useFilter && !mKeyFilters[hf].MayContain(aSigArray[hf][sig])){
+					emptyBins[sig - sigBegin]++;
+					continue;
+				}
+				if (mUseQuotientKeys){
+					unsigned setId;
+					if (mKeyTables[hf].Find(aSigArray[hf][sig], setId))
+						setIds.push_back(setId);
+					else
+						emptyBins[sig - sigBegin]++;
+					continue;
+				}
+				setIndexSingleTy::const_iterator it = mSetIndex[hf].find(aSigArray[hf][sig]);
+				if (it != mSetIndex[hf].end())
+					setIds.push_back(it->second);
+				else
+					emptyBins[sig - sigBegin]++;
+			}
+		}
+		sort(setIds.begin(),setIds.end());
+		vector<binKeyTy> labels;
+		if (mCompressLabelSets)
+			labels.resize(mMaxLabelSetSize + 8);
+		for (unsigned i = 0; i < setIds.size();){
+			unsigned j = i+1;
+			while (j < setIds.size() && setIds[j] == setIds[i])
+				j++;
+			unsigned hits = j-i;
+			if (mCompressLabelSets){
+				unsigned size = PostingListCodec::Decode(&mPackedLabelSets[mLabelSetOffsets[setIds[i]]], &labels[0]);
+				for (unsigned l=0;l<size;++l){
+					hist.Add(labels[l]-1, hits);
+				}
+			} else {
+				const binKeyTy* myValue = GetLabelSet(setIds[i]);
+				for (unsigned l=1;l<=myValue[0];++l){
+					hist.Add(myValue[l]-1, hits);
+				}
+			}
+			i = j;
+		}
+		return;
+	}
 
 	for (unsigned hf = 0; hf < aSigArray.size(); ++hf) {
-		for (unsigned sig = 0; sig < aSigArray[hf].size(); ++sig){
-			if (mInverseIndex[hf].count(aSigArray[hf][sig]) != 0) {
-				indexBinTy& myValue = mInverseIndex[hf][aSigArray[hf][sig]];
+		PrefetchGroup(hf, aSigArray[hf], sigBegin, sigEnd);
+		for (unsigned sig = sigBegin; sig < sigEnd; ++sig){
+			if ((sig - sigBegin) % PREFETCH_GROUP == 0)
+				PrefetchGroup(hf, aSigArray[hf], sig + PREFETCH_GROUP, sigEnd);
+			if (useFilter && !mKeyFilters[hf].MayContain(aSigArray[hf][sig])){
+				emptyBins[sig - sigBegin]++;
+				continue;
+			}
+			indexSingleTy::const_iterator it = mInverseIndex[hf].find(aSigArray[hf][sig]);
+			if (it != mInverseIndex[hf].end()) {
+				const binKeyTy* myValue = it->second;
 				for (unsigned i=1;i<=myValue[0];++i){
-					hist[myValue[i]-1] += 1;
+					hist.Add(myValue[i]-1, 1);
 				}
 
 			} else {
-				emptyBins[sig]++;
+				emptyBins[sig - sigBegin]++;
 			}
 		}
 	}
 }
 
 
-void HistogramIndex::writeBinaryIndex2(ostream &out, const indexTy& index) {
-	// create binary reverse index representation
-	// format:
+void HistogramIndex::ComputeHistogramHierarchical(const vector<vector<unsigned>>& aSigArray, SparseHistogram& hist, vector<unsigned>& emptyBins, unsigned sigBegin, unsigned sigEnd) {
+
+	const bool useFilter = mKeyFilters.size() != 0;
+
+	// coarse: hits per group, a key of several groups counts for each of them
+	vector<unsigned> setIds;
+	setIds.reserve(aSigArray.size()*(sigEnd-sigBegin));
+	for (unsigned hf = 0; hf < aSigArray.size(); ++hf) {
+		PrefetchGroup(hf, aSigArray[hf], sigBegin, sigEnd);
+		for (unsigned sig = sigBegin; sig < sigEnd; ++sig){
+			if ((sig - sigBegin) % PREFETCH_GROUP == 0)
+				PrefetchGroup(hf, aSigArray[hf], sig + PREFETCH_GROUP, sigEnd);
+			if (useFilter && !mKeyFilters[hf].MayContain(aSigArray[hf][sig])){
+				emptyBins[sig - sigBegin]++;
+				continue;
+			}
+			setIndexSingleTy::const_iterator it = mCoarseIndex[hf].find(aSigArray[hf][sig]);
+			if (it != mCoarseIndex[hf].end())
+				setIds.push_back(it->second);
+			else
+				emptyBins[sig - sigBegin]++;
+		}
+	}
+	if (setIds.empty())
+		return;
+
+	sort(setIds.begin(),setIds.end());
+	vector<unsigned> groupHits(mNumGroups+1, 0);
+	unsigned maxHits = 0;
+	for (unsigned i = 0; i < setIds.size();){
+		unsigned j = i+1;
+		while (j < setIds.size() && setIds[j] == setIds[i])
+			j++;
+		const binKeyTy* groups = GetLabelSet(setIds[i]);
+		for (unsigned g=1;g<=groups[0];++g){
+			groupHits[groups[g]] += j-i;
+			maxHits = std::max(maxHits, groupHits[groups[g]]);
+		}
+		i = j;
+	}
+
+	// fine: only the best groups are refined to their labels
+	const double minHits = std::max(1.0, mpParameters->mHierarchyGroupFraction*maxHits);
+	for (unsigned group = 1; group <= mNumGroups; ++group) {
+		if (groupHits[group] < minHits)
+			continue;
+		const setIndexTy& groupIndex = mGroupIndex[group-1];
+		setIds.clear();
+		for (unsigned hf = 0; hf < aSigArray.size(); ++hf) {
+			for (unsigned sig = sigBegin; sig < sigEnd; ++sig){
+				setIndexSingleTy::const_iterator it = groupIndex[hf].find(aSigArray[hf][sig]);
+				if (it != groupIndex[hf].end())
+					setIds.push_back(it->second);
+			}
+		}
+		sort(setIds.begin(),setIds.end());
+		for (unsigned i = 0; i < setIds.size();){
+			unsigned j = i+1;
+			while (j < setIds.size() && setIds[j] == setIds[i])
+				j++;
+			const binKeyTy* myValue = GetLabelSet(setIds[i]);
+			for (unsigned l=1;l<=myValue[0];++l){
+				hist.Add(myValue[l]-1, j-i);
+			}
+			i = j;
+		}
+	}
+}
+
+const HistogramIndex::binKeyTy* HistogramIndex::LookupBin(unsigned hf, unsigned key, unsigned& size, vector<binKeyTy>& buf) const {
+
+	if (mKeyFilters.size() != 0 && !mKeyFilters[hf].MayContain(key))
+		return nullptr;
+
+	const binKeyTy* bin = nullptr;
+	if (mFlatIndex.IsAttached()){
+		bin = mFlatIndex.Find(hf,key);
+	} else if (mUseInlineBins){
+		return mInlineTables[hf].Find(key,size);
+	} else if (mUseLabelSets){
+		unsigned setId;
+		if (mUseQuotientKeys){
+			if (!mKeyTables[hf].Find(key,setId))
+				return nullptr;
+		} else {
+			setIndexSingleTy::const_iterator it = mSetIndex[hf].find(key);
+			if (it == mSetIndex[hf].end())
+				return nullptr;
+			setId = it->second;
+		}
+		if (mCompressLabelSets){
+			size = PostingListCodec::Decode(&mPackedLabelSets[mLabelSetOffsets[setId]], &buf[0]);
+			return &buf[0];
+		}
+		bin = GetLabelSet(setId);
+	} else {
+		indexSingleTy::const_iterator it = mInverseIndex[hf].find(key);
+		if (it != mInverseIndex[hf].end())
+			bin = it->second;
+	}
+
+	if (bin == nullptr)
+		return nullptr;
+	size = bin[0];
+	return bin+1;
+}
+
+bool HistogramIndex::ScreenInstance(const vector<vector<unsigned>>& aSigArray, unsigned numHashFunctions, unsigned minHits) {
+
+	vector<binKeyTy> buf;
+	if (mCompressLabelSets)
+		buf.resize(mMaxLabelSetSize + 8);
+
+	// hits are counted per window, a sequence passes if one of its windows has minHits hits
+	vector<unsigned> hits(aSigArray[0].size(), 0);
+	for (unsigned hf = 0; hf < std::min(numHashFunctions, (unsigned)aSigArray.size()); ++hf) {
+		PrefetchGroup(hf, aSigArray[hf], 0, aSigArray[hf].size());
+		for (unsigned sig = 0; sig < aSigArray[hf].size(); ++sig){
+			if (sig % PREFETCH_GROUP == 0)
+				PrefetchGroup(hf, aSigArray[hf], sig + PREFETCH_GROUP, aSigArray[hf].size());
+			unsigned size;
+			bool hit;
+			if (mUseHierarchy)
+				hit = (!mKeyFilters.size() || mKeyFilters[hf].MayContain(aSigArray[hf][sig])) && mCoarseIndex[hf].count(aSigArray[hf][sig]);
+			else
+				hit = LookupBin(hf, aSigArray[hf][sig], size, buf) != nullptr;
+			if (hit && ++hits[sig] >= minHits)
+				return true;
+		}
+	}
+	return false;
+}
+
+// LSD radix sort by key, passes over bytes in which all keys are equal are skipped
+static void RadixSortBatchQueries(vector<HistogramIndex::batchQueryS>& queries){
+
+	vector<HistogramIndex::batchQueryS> tmp(queries.size());
+	for (unsigned shift = 0; shift < 64; shift += 8){
+		size_t count[257] = {0};
+		for (size_t i = 0; i < queries.size(); i++)
+			count[((queries[i].key >> shift) & 255) + 1]++;
+		if (count[((queries[0].key >> shift) & 255) + 1] == queries.size())
+			continue;
+		for (unsigned d = 0; d < 256; d++)
+			count[d+1] += count[d];
+		for (size_t i = 0; i < queries.size(); i++)
+			tmp[count[(queries[i].key >> shift) & 255]++] = queries[i];
+		queries.swap(tmp);
+	}
+}
+
+void HistogramIndex::ComputeHistogramBatch(ChunkT::iterator begin, ChunkT::iterator end, vector<vector<unsigned> >& hits, vector<vector<unsigned> >& emptyBins) {
+
+	unsigned numInstances = end - begin;
+	hits.resize(numInstances);
+	emptyBins.resize(numInstances);
+
+	vector<batchQueryS> queries;
+	unsigned instance = 0;
+	for (ChunkT::iterator it = begin; it != end; ++it, ++instance){
+		hits[instance].clear();
+		emptyBins[instance].assign(it->minHashes[0].size(), 0);
+		for (unsigned hf = 0; hf < it->minHashes.size(); ++hf) {
+			for (unsigned sig = 0; sig < it->minHashes[hf].size(); ++sig){
+				batchQueryS query = {((uint64_t)hf << 32) | it->minHashes[hf][sig], instance, sig};
+				queries.push_back(query);
+			}
+		}
+	}
+	if (queries.size() == 0)
+		return;
+	RadixSortBatchQueries(queries);
+
+	vector<binKeyTy> buf(mMaxLabelSetSize + 8);
+	for (size_t q = 0; q < queries.size();){
+		if (q + PREFETCH_GROUP < queries.size())
+			PrefetchKey(queries[q + PREFETCH_GROUP].key >> 32, (unsigned)queries[q + PREFETCH_GROUP].key);
+		unsigned size = 0;
+		const binKeyTy* labels = LookupBin(queries[q].key >> 32, (unsigned)queries[q].key, size, buf);
+		size_t r = q;
+		for (; r < queries.size() && queries[r].key == queries[q].key; ++r){
+			if (labels == nullptr){
+				emptyBins[queries[r].instance][queries[r].sig]++;
+				continue;
+			}
+			vector<unsigned>& instanceHits = hits[queries[r].instance];
+			for (unsigned i=0;i<size;++i){
+				instanceHits.push_back(labels[i]-1);
+			}
+		}
+		q = r;
+	}
+}
+
+
+void HistogramIndex::writeIndexHeader(ostream &out) {
+	// index parameters and feature table, shared by *.bhi files and shared memory segments
 	out.write((const char*) &INDEX_FORMAT_VERSION, sizeof(unsigned));
 	out.write((const char*) &mpParameters->mHashBitSize, sizeof(unsigned));
 	out.write((const char*) &mpParameters->mRandomSeed, sizeof(unsigned));
@@ -1232,6 +1665,13 @@ void HistogramIndex::writeBinaryIndex2(ostream &out, const indexTy& index) {
 	out.write((const char*) &mpParameters->mIndexSeqShift, sizeof(unsigned));
 	unsigned tmp = GetHistogramSize();
 	out.write((const char*) &tmp, sizeof(unsigned));
+	out.write((const char*) &mIndexFlags, sizeof(unsigned));
+	if (mIndexFlags & INDEX_FLAG_PRUNED){
+		out.write((const char*) &mpParameters->mPruneMaxBinSize, sizeof(unsigned));
+		out.write((const char*) &mpParameters->mPruneMaxEntropy, sizeof(double));
+	}
+	if (mIndexFlags & INDEX_FLAG_KEY_FILTER)
+		out.write((const char*) &mKeyFilterBits, sizeof(unsigned));
 
 	if (mFeature2IndexValue.size() != GetHistogramSize()){
 		throw range_error("Ups! Histogramsize is different to mFeature2IndexValue.size()");
@@ -1245,33 +1685,64 @@ void HistogramIndex::writeBinaryIndex2(ostream &out, const indexTy& index) {
 		out.write((const char*) &(tmp), sizeof(unsigned));
 		out.write(const_cast<char*>(it->first.c_str()), it->first.size());
 	} while ( mFeature2IndexValue.value_comp()(*it++, highest) );
+}
+
+void HistogramIndex::writeBinaryIndex2(ostream &out, const indexTy& index) {
+	// create binary reverse index representation
+	// format:
+	//   header (parameters, flags, feature table), numHashFunc,
+	//   per sub index: numBins, numBins x (key, numBinEntries, numBinEntries x label)
+	//   optional (INDEX_FLAG_KEY_FILTER): per sub index a Bloom filter of its keys
+	// keys are written sorted, so that index files can be merged as streams
+	mIndexFlags |= INDEX_FLAG_SORTED_KEYS;
+	if (mIndexFlags & INDEX_FLAG_KEY_FILTER)
+		BuildKeyFilters(index);
+	writeIndexHeader(out);
 
 	unsigned numHashFunc = index.size();
 	out.write((const char*) &numHashFunc, sizeof(unsigned));
+	vector<pair<unsigned,binKeyTy*> > bins;
 	for (typename indexTy::const_iterator it = index.begin(); it!= index.end(); it++){
 		unsigned numBins = it->size();
 		out.write((const char*) &numBins, sizeof(unsigned));
-		for (typename indexSingleTy::const_iterator itBin = it->begin(); itBin!=it->end(); itBin++){
-			unsigned binId = itBin->first;
 
-			unsigned numBinEntries = itBin->second[0];
-			out.write((const char*) &binId, sizeof(unsigned));
-			out.write((const char*) &numBinEntries, sizeof(unsigned));
+		// the keys are sorted in up to 16 key ranges, one range at a time: only (key, bin pointer)
+		// pairs of one range are held in addition to the index, the bins are not copied
+		unsigned maxKey = 0;
+		for (typename indexSingleTy::const_iterator b = it->begin(); b != it->end(); b++)
+			maxKey = std::max(maxKey, b->first);
+		const uint64_t numRanges = std::min((uint64_t)16, (uint64_t)numBins/1048576 + 1);
+		const uint64_t rangeSize = ((uint64_t)maxKey + numRanges) / numRanges;
+
+		for (uint64_t r = 0; r < numRanges; r++){
+			const uint64_t rangeBegin = r * rangeSize;
+			const uint64_t rangeEnd = rangeBegin + rangeSize;
+			bins.clear();
+			for (typename indexSingleTy::const_iterator b = it->begin(); b != it->end(); b++){
+				if (b->first >= rangeBegin && b->first < rangeEnd)
+					bins.push_back(*b);
+			}
+			sort(bins.begin(),bins.end());
 
-			for (binKeyTy i=1;i<=numBinEntries;i++){
-				binKeyTy s = itBin->second[i];
-				out.write((const char*) &(s), sizeof(binKeyTy));
+			for (unsigned b = 0; b < bins.size(); b++){
+				unsigned binId = bins[b].first;
+
+				unsigned numBinEntries = bins[b].second[0];
+				out.write((const char*) &binId, sizeof(unsigned));
+				out.write((const char*) &numBinEntries, sizeof(unsigned));
+				out.write((const char*) &bins[b].second[1], numBinEntries*sizeof(binKeyTy));
 			}
 		}
 	}
+	for (unsigned hf = 0; hf < mKeyFilters.size(); hf++)
+		mKeyFilters[hf].Write(out);
 }
 
-bool HistogramIndex::readBinaryIndex2(string filename, indexTy &index){
-	igzstream fin;
-	fin.open(filename.c_str());
+bool HistogramIndex::readIndexHeader(istream &fin){
 	unsigned tmp;
 	fin.read((char*) &tmp, sizeof(unsigned));
-	if (tmp != INDEX_FORMAT_VERSION) {
+	unsigned version = tmp;
+	if (version != INDEX_FORMAT_VERSION && version != INDEX_FORMAT_VERSION_LEGACY) {
 		cout << endl << endl << "Incompatible Index file format - Index file has version " << tmp  << ", but this program uses version " << INDEX_FORMAT_VERSION << "!" << endl;
 		cout << "Please re-create index with this program!" << endl;
 		return false;
@@ -1289,6 +1760,15 @@ bool HistogramIndex::readBinaryIndex2(string filename, indexTy &index){
 	fin.read((char*) &mpParameters->mIndexSeqShift, sizeof(unsigned));
 	fin.read((char*) &tmp, sizeof(unsigned));
 	SetHistogramSize(tmp);
+	mIndexFlags = 0;
+	if (version != INDEX_FORMAT_VERSION_LEGACY)
+		fin.read((char*) &mIndexFlags, sizeof(unsigned));
+	if (mIndexFlags & INDEX_FLAG_PRUNED){
+		fin.read((char*) &mpParameters->mPruneMaxBinSize, sizeof(unsigned));
+		fin.read((char*) &mpParameters->mPruneMaxEntropy, sizeof(double));
+	}
+	if (mIndexFlags & INDEX_FLAG_KEY_FILTER)
+		fin.read((char*) &mKeyFilterBits, sizeof(unsigned));
 
 	mFeature2IndexValue.clear();
 	for (unsigned idx=1;idx<=GetHistogramSize();idx++){
@@ -1302,6 +1782,14 @@ bool HistogramIndex::readBinaryIndex2(string filename, indexTy &index){
 		fin.read(const_cast<char*>(feature.c_str()), size);
 		mFeature2IndexValue.insert(make_pair(feature,hist_idx));
 	}
+	return fin.good();
+}
+
+bool HistogramIndex::readBinaryIndex2(string filename, indexTy &index){
+	igzstream fin;
+	fin.open(filename.c_str());
+	if (!readIndexHeader(fin))
+		return false;
 
 	//unsigned numHashFunc = 0;
 	fin.read((char*) &mpParameters->mNumHashFunctions, sizeof(unsigned));
@@ -1313,6 +1801,9 @@ bool HistogramIndex::readBinaryIndex2(string filename, indexTy &index){
 	InitInverseIndex();
 
 	cout << endl << "read "<< mpParameters->mNumHashFunctions << " sub indices ..." << endl;
+	vector<binKeyTy> labelSet;
+	uint64_t numKeys = 0;
+	uint64_t binEntries = 0;
 	for (unsigned  hashFunc = 0; hashFunc < mpParameters->mNumHashFunctions; hashFunc++){
 
 		unsigned numBins = 0;
@@ -1322,7 +1813,10 @@ bool HistogramIndex::readBinaryIndex2(string filename, indexTy &index){
 		if (!fin.good())
 			return false;
 
-		index[hashFunc].rehash(numBins);
+		if (mUseLabelSets)
+			mSetIndex[hashFunc].rehash(numBins);
+		else
+			index[hashFunc].rehash(numBins);
 		cout << "sub index "<< hashFunc+1 << " (keys="<< numBins << ") : "<< flush;
 		for (unsigned  bin = 0; bin < numBins; bin++){
 			if (bin%(unsigned)(std::ceil((double)numBins/100.0))==0){
@@ -1336,6 +1830,18 @@ bool HistogramIndex::readBinaryIndex2(string filename, indexTy &index){
 				fin.setstate(std::ios::badbit);
 			if (!fin.good())
 				return false;
+
+			if (mUseLabelSets){
+				labelSet.resize(numBinEntries+1);
+				labelSet[0] = numBinEntries;
+				fin.read((char*) &labelSet[1], numBinEntries*sizeof(binKeyTy));
+				if (!fin.good())
+					return false;
+				mSetIndex[hashFunc][binId] = InternLabelSet(&labelSet[0]);
+				numKeys++;
+				binEntries += numBinEntries;
+				continue;
+			}
 			//		indexBinTy tmp = indexBinTy(numBinEntries);
 			binKeyTy* tmp;
 			switch (numBinEntries){
@@ -1394,10 +1900,537 @@ bool HistogramIndex::readBinaryIndex2(string filename, indexTy &index){
 		}
 		cout << endl;
 	}
+
+	mKeyFilters.clear();
+	if (mIndexFlags & INDEX_FLAG_KEY_FILTER){
+		mKeyFilters.resize(mpParameters->mNumHashFunctions);
+		for (unsigned hf = 0; hf < mKeyFilters.size(); hf++){
+			if (!mKeyFilters[hf].Read(fin))
+				return false;
+		}
+		cout << "key filters with " << mKeyFilterBits << " bits per key" << endl;
+	}
 	fin.close();
+	if (mUseLabelSets)
+		FinishLabelSetIndex(numKeys, binEntries);
 	return true;
 }
 
+void HistogramIndex::PublishSharedIndex(const string& name, bool hugePages){
+
+	ostringstream meta;
+	writeIndexHeader(meta);
+	unsigned numHashFunc = mInverseIndex.size();
+	meta.write((const char*) &numHashFunc, sizeof(unsigned));
+
+	vector<FlatIndex::binListT> bins(numHashFunc);
+	for (unsigned hf = 0; hf < numHashFunc; hf++){
+		bins[hf].reserve(mInverseIndex[hf].size());
+		for (typename indexSingleTy::const_iterator itBin = mInverseIndex[hf].begin(); itBin!=mInverseIndex[hf].end(); itBin++){
+			bins[hf].push_back(make_pair(itBin->first,itBin->second));
+		}
+	}
+
+	// the key filters follow in place, their blocks are aligned to 32 bytes and used directly by attached processes
+	for (unsigned hf = 0; hf < mKeyFilters.size(); hf++){
+		while ((uint64_t(meta.tellp()) + sizeof(uint64_t)) % 32 != 0)
+			meta.put(0);
+		mKeyFilters[hf].Write(meta);
+	}
+
+	mSharedSegment.Publish(name, meta.str(), bins, mpParameters->mHashBitSize, GetHistogramSize(), hugePages);
+}
+
+bool HistogramIndex::AttachSharedIndex(const string& name){
+
+	mSharedSegment.Attach(name);
+
+	istringstream meta(mSharedSegment.GetMeta());
+	if (!readIndexHeader(meta))
+		return false;
+	meta.read((char*) &mpParameters->mNumHashFunctions, sizeof(unsigned));
+	if (!meta.good())
+		return false;
+
+	mFlatIndex.Attach(mSharedSegment.GetFlatBlob());
+	if (mFlatIndex.GetHeader().numHashFunctions != mpParameters->mNumHashFunctions)
+		throw range_error("ERROR shared index " + name + " is inconsistent!");
+
+	mKeyFilters.clear();
+	if (mIndexFlags & INDEX_FLAG_KEY_FILTER){
+		const char* data = mSharedSegment.GetMetaData();
+		uint64_t size = mSharedSegment.GetMetaSize();
+		uint64_t pos = meta.tellg();
+		mKeyFilters.resize(mpParameters->mNumHashFunctions);
+		for (unsigned hf = 0; hf < mKeyFilters.size(); hf++){
+			while ((pos + sizeof(uint64_t)) % 32 != 0)
+				pos++;
+			uint64_t used = (pos < size) ? mKeyFilters[hf].View(data + pos, size - pos) : 0;
+			if (used == 0)
+				throw range_error("ERROR key filters of shared index " + name + " are missing, publish it again!");
+			pos += used;
+		}
+		cout << "key filters with " << mKeyFilterBits << " bits per key" << endl;
+	}
+	return true;
+}
+
+void HistogramIndex::InitSpillIndex(const string& prefix){
+
+	unsigned numIndexThreads = min(max((unsigned)1,mpParameters->mNumIndexThreads),mpParameters->mNumHashFunctions);
+
+	mSpillIndex = true;
+	mSpillPrefix = prefix;
+	mSpillCapacity = max((uint64_t)1048576, ((uint64_t)mpParameters->mMaxBuildMemory*1048576)/(numIndexThreads*sizeof(uint64_t)));
+	mSpillBuffers.clear();
+	mSpillBuffers.resize(mpParameters->mNumHashFunctions);
+
+	cout << "Out-of-core index build: " << numIndexThreads << " buffers with " << mSpillCapacity << " entries (" << (mSpillCapacity*sizeof(uint64_t))/1048576 << " MB) each" << endl;
+}
+
+void HistogramIndex::FlushSpillBuffer(unsigned buf){
+
+	vector<uint64_t>& entries = mSpillBuffers[buf].entries;
+	if (entries.size() == 0)
+		return;
+
+	sort(entries.begin(),entries.end());
+	entries.erase(unique(entries.begin(),entries.end()),entries.end());
+
+	string filename = mSpillPrefix + "." + std::to_string(buf) + "." + std::to_string(mSpillBuffers[buf].runFiles.size());
+	ofstream fout(filename.c_str(), std::ios::binary | std::ios::trunc);
+	fout.write((const char*) entries.data(), entries.size()*sizeof(uint64_t));
+	if (!fout.good())
+		throw range_error("ERROR cannot write index run file " + filename);
+	fout.close();
+
+	mSpillBuffers[buf].runFiles.push_back(filename);
+	entries.clear();
+}
+
+void HistogramIndex::MergeSpilledIndex(ostream &out){
+
+	// buffered sequential reader for one sorted run file
+	struct runReaderS {
+		ifstream in;
+		vector<uint64_t> buf;
+		size_t pos;
+		size_t len;
+		bool Next(uint64_t& val){
+			if (pos == len){
+				in.read((char*) buf.data(), buf.size()*sizeof(uint64_t));
+				len = in.gcount()/sizeof(uint64_t);
+				pos = 0;
+				if (len == 0)
+					return false;
+			}
+			val = buf[pos++];
+			return true;
+		}
+	};
+
+	vector<string> runFiles;
+	for (unsigned b = 0; b < mSpillBuffers.size(); b++){
+		FlushSpillBuffer(b);
+		vector<uint64_t>().swap(mSpillBuffers[b].entries);
+		runFiles.insert(runFiles.end(),mSpillBuffers[b].runFiles.begin(),mSpillBuffers[b].runFiles.end());
+	}
+
+	cout << "merge " << runFiles.size() << " index runs ..." << endl;
+
+	vector<runReaderS> runs(runFiles.size());
+	typedef pair<uint64_t,unsigned> heapEntryT;
+	std::priority_queue<heapEntryT, vector<heapEntryT>, std::greater<heapEntryT> > heap;
+	for (unsigned r = 0; r < runs.size(); r++){
+		runs[r].in.open(runFiles[r].c_str(), std::ios::binary);
+		if (!runs[r].in.good())
+			throw range_error("ERROR cannot read index run file " + runFiles[r]);
+		runs[r].buf.resize(65536);
+		runs[r].pos = 0;
+		runs[r].len = 0;
+		uint64_t val;
+		if (runs[r].Next(val))
+			heap.push(make_pair(val,r));
+	}
+
+	InitPruning();
+	mIndexFlags |= INDEX_FLAG_SORTED_KEYS;
+	writeIndexHeader(out);
+	unsigned numHashFunc = mpParameters->mNumHashFunctions;
+	out.write((const char*) &numHashFunc, sizeof(unsigned));
+
+	// keys of a sub index are written in sorted order, the number of keys is patched afterwards
+	unsigned curHf = 0;
+	unsigned curKey = 0;
+	unsigned numBins = 0;
+	uint64_t numEntries = 0;
+	std::streampos numBinsPos = out.tellp();
+	out.write((const char*) &numBins, sizeof(unsigned));
+	vector<binKeyTy> labels;
+
+	auto writeBin = [&](){
+		if (labels.size() == 0)
+			return;
+		if (PruneBin(labels.size())){
+			labels.clear();
+			return;
+		}
+		unsigned numBinEntries = labels.size();
+		out.write((const char*) &curKey, sizeof(unsigned));
+		out.write((const char*) &numBinEntries, sizeof(unsigned));
+		out.write((const char*) labels.data(), numBinEntries*sizeof(binKeyTy));
+		numEntries += numBinEntries;
+		numBins++;
+		labels.clear();
+	};
+
+	auto finishSection = [&](){
+		writeBin();
+		std::streampos pos = out.tellp();
+		out.seekp(numBinsPos);
+		out.write((const char*) &numBins, sizeof(unsigned));
+		out.seekp(pos);
+		cout << "sub index "<< curHf+1 << " (keys="<< numBins << ")" << endl;
+		curHf++;
+		numBins = 0;
+		if (curHf < numHashFunc){
+			numBinsPos = out.tellp();
+			out.write((const char*) &numBins, sizeof(unsigned));
+		}
+	};
+
+	while (!heap.empty()){
+		heapEntryT top = heap.top();
+		heap.pop();
+		uint64_t val;
+		if (runs[top.second].Next(val))
+			heap.push(make_pair(val,top.second));
+
+		unsigned hf    = top.first >> 48;
+		unsigned key   = (top.first >> 16) & 0xFFFFFFFF;
+		binKeyTy label = top.first & 0xFFFF;
+
+		while (hf > curHf)
+			finishSection();
+		if (key != curKey){
+			writeBin();
+			curKey = key;
+		}
+		if (labels.size() == 0 || labels.back() != label)
+			labels.push_back(label);
+	}
+	while (curHf < numHashFunc)
+		finishSection();
+
+	if (!out.good())
+		throw range_error("ERROR writing merged index failed!");
+
+	for (unsigned r = 0; r < runs.size(); r++){
+		runs[r].in.close();
+		remove(runFiles[r].c_str());
+	}
+	mSpillBuffers.clear();
+	mSpillIndex = false;
+
+	cout << "merged " << numEntries << " index entries" << endl;
+	PrintPruneStats();
+}
+
+// sequential access to the bins of one sub index of an index file, labels are mapped
+// to the merged label space; sub indices without sorted keys are loaded and sorted first
+class IndexSectionReader {
+public:
+	typedef HistogramIndex::binKeyTy binKeyTy;
+
+	unsigned 			mKey;
+	vector<binKeyTy> 	mLabels;
+
+	IndexSectionReader(istream& in, bool sorted, const vector<binKeyTy>& remap)
+	:mKey(0), mIn(in), mSorted(sorted), mRemap(remap), mNumBins(0), mPos(0) {};
+
+	unsigned Start(){
+		mPos = 0;
+		mIn.read((char*) &mNumBins, sizeof(unsigned));
+		mBins.clear();
+		if (!mSorted){
+			mBins.resize(mNumBins);
+			for (unsigned b = 0; b < mNumBins; b++){
+				ReadBin(mBins[b].first, mBins[b].second);
+			}
+			sort(mBins.begin(), mBins.end());
+		}
+		return mNumBins;
+	}
+
+	bool Next(){
+		if (mPos >= mNumBins)
+			return false;
+		if (mSorted){
+			ReadBin(mKey, mLabels);
+		} else {
+			mKey = mBins[mPos].first;
+			mLabels.swap(mBins[mPos].second);
+		}
+		mPos++;
+		return true;
+	}
+
+private:
+	istream& 					mIn;
+	bool 							mSorted;
+	const vector<binKeyTy>& mRemap;
+	unsigned 					mNumBins;
+	unsigned 					mPos;
+	vector<pair<unsigned,vector<binKeyTy> > > mBins;
+
+	void ReadBin(unsigned& key, vector<binKeyTy>& labels){
+		unsigned numBinEntries = 0;
+		mIn.read((char*) &key, sizeof(unsigned));
+		mIn.read((char*) &numBinEntries, sizeof(unsigned));
+		labels.resize(numBinEntries);
+		mIn.read((char*) labels.data(), numBinEntries*sizeof(binKeyTy));
+		if (!mIn.good())
+			throw range_error("ERROR reading index file failed!");
+		for (unsigned i = 0; i < numBinEntries; i++){
+			if (labels[i] >= mRemap.size() || mRemap[labels[i]] == 0)
+				throw range_error("ERROR index file contains unknown label id " + std::to_string(labels[i]));
+			labels[i] = mRemap[labels[i]];
+		}
+	}
+};
+
+void HistogramIndex::MergeIndexFiles(const vector<string>& filenames, ostream &out){
+
+	vector<std::shared_ptr<igzstream> > files;
+	vector<vector<binKeyTy> > remap(filenames.size());
+	vector<bool> sorted(filenames.size());
+	vector<unsigned> params;
+	map<string,uint> features;
+	unsigned numHashFunc = 0;
+	unsigned maxIdx = 0;
+	unsigned filterBits = 0;
+
+	for (unsigned f = 0; f < filenames.size(); f++){
+		files.push_back(std::make_shared<igzstream>(filenames[f].c_str()));
+		igzstream& fin = *files.back();
+		if (!fin.good() || !readIndexHeader(fin))
+			throw range_error("ERROR cannot read index header from " + filenames[f]);
+
+		vector<unsigned> p = {mpParameters->mHashBitSize, mpParameters->mRandomSeed, mpParameters->mRadius, mpParameters->mMinRadius,
+				mpParameters->mDistance, mpParameters->mMinDistance, mpParameters->mNumHashShingles, mpParameters->mNumRepeatsHashFunction,
+				mpParameters->mSeqWindow, mpParameters->mIndexSeqShift};
+		unsigned n = 0;
+		fin.read((char*) &n, sizeof(unsigned));
+		if (f == 0){
+			params = p;
+			numHashFunc = n;
+		} else if (p != params || n != numHashFunc){
+			throw range_error("ERROR index " + filenames[f] + " was built with different index parameters than " + filenames[0] + "!");
+		}
+		sorted[f] = (mIndexFlags & INDEX_FLAG_SORTED_KEYS);
+		if (mIndexFlags & INDEX_FLAG_PRUNED)
+			throw range_error("ERROR index " + filenames[f] + " is pruned, only unpruned indices can be merged!");
+		// the key filters of the inputs cannot be combined, they are built again for the merged keys
+		if (mIndexFlags & INDEX_FLAG_KEY_FILTER)
+			filterBits = max(filterBits, mKeyFilterBits);
+
+		// labels are identified by name, new names get ids after all ids seen so far
+		for (map<string,uint>::iterator it = mFeature2IndexValue.begin(); it != mFeature2IndexValue.end(); ++it){
+			if (features.count(it->first) == 0){
+				features[it->first] = (f == 0) ? it->second : ++maxIdx;
+			}
+			maxIdx = max(maxIdx,features[it->first]);
+			if (remap[f].size() <= it->second)
+				remap[f].resize(it->second+1,0);
+			remap[f][it->second] = features[it->first];
+		}
+		if (maxIdx > MAXBINKEY)
+			throw range_error("ERROR merged index has more than " + std::to_string(MAXBINKEY) + " labels!");
+
+		cout << "index " << filenames[f] << " : " << mFeature2IndexValue.size() << " labels" << (sorted[f] ? "" : " (unsorted keys)") << endl;
+	}
+
+	mpParameters->mNumHashFunctions = numHashFunc;
+	mFeature2IndexValue = features;
+	SetHistogramSize(features.size());
+	mIndexFlags = INDEX_FLAG_SORTED_KEYS;
+	mKeyFilterBits = filterBits;
+	if (mKeyFilterBits > 0)
+		mIndexFlags |= INDEX_FLAG_KEY_FILTER;
+	InitPruning();
+	writeIndexHeader(out);
+	out.write((const char*) &numHashFunc, sizeof(unsigned));
+
+	cout << "merged index : " << GetHistogramSize() << " labels" << endl;
+	if (mKeyFilterBits > 0)
+		cout << "build key filters with " << mKeyFilterBits << " bits per key" << endl;
+	mKeyFilters.assign((mKeyFilterBits > 0) ? numHashFunc : 0, BlockedBloomFilter());
+
+	vector<std::shared_ptr<IndexSectionReader> > readers;
+	for (unsigned f = 0; f < filenames.size(); f++)
+		readers.push_back(std::make_shared<IndexSectionReader>(*files[f], sorted[f], remap[f]));
+
+	vector<binKeyTy> labels;
+	vector<unsigned> keys;
+	for (unsigned hf = 0; hf < numHashFunc; hf++){
+
+		keys.clear();
+		vector<bool> active(readers.size());
+		for (unsigned f = 0; f < readers.size(); f++){
+			readers[f]->Start();
+			active[f] = readers[f]->Next();
+		}
+
+		unsigned numBins = 0;
+		std::streampos numBinsPos = out.tellp();
+		out.write((const char*) &numBins, sizeof(unsigned));
+
+		while (true){
+			bool any = false;
+			unsigned key = 0;
+			for (unsigned f = 0; f < readers.size(); f++){
+				if (active[f] && (!any || readers[f]->mKey < key)){
+					key = readers[f]->mKey;
+					any = true;
+				}
+			}
+			if (!any)
+				break;
+
+			labels.clear();
+			for (unsigned f = 0; f < readers.size(); f++){
+				if (active[f] && readers[f]->mKey == key){
+					labels.insert(labels.end(), readers[f]->mLabels.begin(), readers[f]->mLabels.end());
+					active[f] = readers[f]->Next();
+				}
+			}
+			sort(labels.begin(),labels.end());
+			labels.erase(unique(labels.begin(),labels.end()),labels.end());
+			if (PruneBin(labels.size()))
+				continue;
+
+			unsigned numBinEntries = labels.size();
+			out.write((const char*) &key, sizeof(unsigned));
+			out.write((const char*) &numBinEntries, sizeof(unsigned));
+			out.write((const char*) labels.data(), numBinEntries*sizeof(binKeyTy));
+			numBins++;
+			if (mKeyFilters.size() != 0)
+				keys.push_back(key);
+		}
+		if (mKeyFilters.size() != 0){
+			mKeyFilters[hf].Init(keys.size(), mKeyFilterBits);
+			for (unsigned i = 0; i < keys.size(); i++)
+				mKeyFilters[hf].Add(keys[i]);
+		}
+
+		std::streampos pos = out.tellp();
+		out.seekp(numBinsPos);
+		out.write((const char*) &numBins, sizeof(unsigned));
+		out.seekp(pos);
+		cout << "sub index "<< hf+1 << " (keys="<< numBins << ")" << endl;
+	}
+	for (unsigned hf = 0; hf < mKeyFilters.size(); hf++)
+		mKeyFilters[hf].Write(out);
+
+	if (!out.good())
+		throw range_error("ERROR writing merged index failed!");
+	PrintPruneStats();
+}
+
+void HistogramIndex::DeleteBin(binKeyTy* bin, unsigned k){
+	switch (bin[0]){
+	case 1:
+		mMemPool_2[k]->deleteElement(reinterpret_cast<newIndexBin_2(*)>(bin));
+		break;
+	case 2:
+		mMemPool_3[k]->deleteElement(reinterpret_cast<newIndexBin_3(*)>(bin));
+		break;
+	case 3:
+		mMemPool_4[k]->deleteElement(reinterpret_cast<newIndexBin_4(*)>(bin));
+		break;
+	case 4:
+		mMemPool_5[k]->deleteElement(reinterpret_cast<newIndexBin_5(*)>(bin));
+		break;
+	case 5:
+		mMemPool_6[k]->deleteElement(reinterpret_cast<newIndexBin_6(*)>(bin));
+		break;
+	case 6:
+		mMemPool_7[k]->deleteElement(reinterpret_cast<newIndexBin_7(*)>(bin));
+		break;
+	case 7:
+		mMemPool_8[k]->deleteElement(reinterpret_cast<newIndexBin_8(*)>(bin));
+		break;
+	case 8:
+		mMemPool_9[k]->deleteElement(reinterpret_cast<newIndexBin_9(*)>(bin));
+		break;
+	case 9:
+		mMemPool_10[k]->deleteElement(reinterpret_cast<newIndexBin_10(*)>(bin));
+		break;
+	default:
+		delete[] bin;
+		break;
+	}
+}
+
+bool HistogramIndex::InitPruning(){
+
+	// bins only store the presence of labels, so the label-set entropy of a key is log2(numLabels);
+	// normalized by the maximal entropy log2(histSize) a key is pruned if numLabels > histSize^maxEntropy
+	mPruneBinSize = mpParameters->mPruneMaxBinSize;
+	if (mpParameters->mPruneMaxEntropy < 1.0 && GetHistogramSize() > 1){
+		unsigned entropyBinSize = max(1.0, std::floor(std::pow((double)GetHistogramSize(), mpParameters->mPruneMaxEntropy) + 1e-9));
+		if (mPruneBinSize == 0 || entropyBinSize < mPruneBinSize)
+			mPruneBinSize = entropyBinSize;
+	}
+
+	mPruneStats = pruneStatsS();
+	if (mPruneBinSize == 0)
+		return false;
+
+	mIndexFlags |= INDEX_FLAG_PRUNED;
+	cout << "Prune index keys with more than " << mPruneBinSize << " labels (prune_max_bin_size=" << mpParameters->mPruneMaxBinSize << ", prune_max_entropy=" << mpParameters->mPruneMaxEntropy << ")" << endl;
+	return true;
+}
+
+void HistogramIndex::PruneInverseIndex(){
+
+	if (!InitPruning())
+		return;
+
+	for (unsigned k = 0; k < mInverseIndex.size(); k++){
+		vector<unsigned> pruned;
+		for (typename indexSingleTy::const_iterator itBin = mInverseIndex[k].begin(); itBin!=mInverseIndex[k].end(); itBin++){
+			if (PruneBin(itBin->second[0]))
+				pruned.push_back(itBin->first);
+		}
+		for (unsigned i = 0; i < pruned.size(); i++){
+			DeleteBin(mInverseIndex[k][pruned[i]],k);
+			mInverseIndex[k].erase(pruned[i]);
+		}
+	}
+	PrintPruneStats();
+}
+
+void HistogramIndex::PrintPruneStats(){
+
+	if (mPruneBinSize == 0 || mPruneStats.bins == 0)
+		return;
+
+	// memory estimate per key: key and bin pointer in the hash map plus the bin itself
+	const uint64_t keyBytes = sizeof(unsigned) + sizeof(indexBinTy) + sizeof(binKeyTy);
+	uint64_t bytes       = mPruneStats.bins*keyBytes + mPruneStats.entries*sizeof(binKeyTy);
+	uint64_t prunedBytes = mPruneStats.prunedBins*keyBytes + mPruneStats.prunedEntries*sizeof(binKeyTy);
+
+	// the percentages are formatted locally, the state of cout is left as it is
+	ostringstream stats;
+	stats << setprecision(3);
+	stats << "Pruned keys          : " << mPruneStats.prunedBins << " of " << mPruneStats.bins << " (" << 100.0*mPruneStats.prunedBins/mPruneStats.bins << "%)" << endl;
+	stats << "Pruned label entries : " << mPruneStats.prunedEntries << " of " << mPruneStats.entries << " (" << 100.0*mPruneStats.prunedEntries/mPruneStats.entries << "%)" << endl;
+	stats << "Saved index memory   : ~" << prunedBytes/1048576 << " MB of ~" << bytes/1048576 << " MB (" << 100.0*prunedBytes/bytes << "%)" << endl;
+	stats << "Saved query cost     : " << 100.0*mPruneStats.prunedCost/mPruneStats.cost << "% (estimated as sum of squared bin sizes)" << endl;
+	cout << stats.str();
+}
+
 //void HistogramIndex::UpdateInverseIndex(vector<unsigned>& aSignature, unsigned aIndex) {
 //	for (unsigned k = 0; k < mpParameters->mNumHashFunctions; ++k) { //for every hash value
 //		unsigned key = aSignature[k];
@@ -1756,3 +2789,214 @@ bool HistogramIndex::readBinaryIndex2(string filename, indexTy &index){
 //		}
 //	}
 //}
+
+unsigned HistogramIndex::InternLabelSet(const binKeyTy* bin){
+
+	// bins are not always sorted, the order of the labels does not matter for the histogram
+	vector<binKeyTy> sortedBin;
+	if (!std::is_sorted(bin+1, bin+bin[0]+1)){
+		sortedBin.assign(bin, bin+bin[0]+1);
+		sort(sortedBin.begin()+1, sortedBin.end());
+		bin = &sortedBin[0];
+	}
+
+	uint64_t h = 14695981039346656037ULL;
+	for (unsigned i = 0; i <= bin[0]; i++){
+		h ^= bin[i];
+		h *= 1099511628211ULL;
+	}
+
+	// encoded label sets are compared byte-wise, the encoding of a sorted set is unique
+	vector<uint8_t> packed;
+	if (mCompressLabelSets)
+		PostingListCodec::Encode(bin+1, bin[0], packed);
+
+	for (spp::sparse_hash_map<uint64_t, unsigned>::const_iterator it = mLabelSetIds.find(h); it != mLabelSetIds.end(); it = mLabelSetIds.find(++h)){
+		if (mCompressLabelSets){
+			uint64_t offset = mLabelSetOffsets[it->second];
+			if (offset + packed.size() <= mPackedLabelSets.size() && memcmp(&mPackedLabelSets[offset], &packed[0], packed.size()) == 0)
+				return it->second;
+		} else {
+			const binKeyTy* labelSet = GetLabelSet(it->second);
+			if (labelSet[0] == bin[0] && memcmp(&labelSet[1], &bin[1], bin[0]*sizeof(binKeyTy)) == 0)
+				return it->second;
+		}
+	}
+
+	if (mLabelSetOffsets.size() == MAXUNSIGNED)
+		throw range_error("ERROR too many label sets for --index_label_sets!");
+	unsigned id = mLabelSetOffsets.size();
+	if (mCompressLabelSets){
+		mLabelSetOffsets.push_back(mPackedLabelSets.size());
+		mPackedLabelSets.insert(mPackedLabelSets.end(), packed.begin(), packed.end());
+	} else {
+		mLabelSetOffsets.push_back(mLabelSetPool.size());
+		mLabelSetPool.insert(mLabelSetPool.end(), bin, bin+bin[0]+1);
+	}
+	mMaxLabelSetSize = std::max(mMaxLabelSetSize, (unsigned)bin[0]);
+	mLabelSetIds[h] = id;
+	return id;
+}
+
+void HistogramIndex::BuildLabelSetIndex(){
+
+	cout << "build label set index ..." << endl;
+
+	uint64_t numKeys = 0;
+	uint64_t binEntries = 0;
+	mSetIndex.resize(mInverseIndex.size());
+	for (unsigned k = 0; k < mInverseIndex.size(); k++){
+		mSetIndex[k].max_load_factor(0.9);
+		mSetIndex[k].set_resizing_parameters(0.0,0.9);
+		mSetIndex[k].rehash(mInverseIndex[k].size());
+		for (typename indexSingleTy::const_iterator itBin = mInverseIndex[k].begin(); itBin!=mInverseIndex[k].end(); itBin++){
+			mSetIndex[k][itBin->first] = InternLabelSet(itBin->second);
+			numKeys++;
+			binEntries += itBin->second[0];
+		}
+		ReleaseInverseIndex(k);
+	}
+	FinishLabelSetIndex(numKeys, binEntries);
+}
+
+void HistogramIndex::ReleaseInverseIndex(unsigned k){
+
+	for (typename indexSingleTy::const_iterator itBin = mInverseIndex[k].begin(); itBin!=mInverseIndex[k].end(); itBin++){
+		if (itBin->second[0] > 9)
+			delete[] itBin->second;
+	}
+	indexSingleTy().swap(mInverseIndex[k]);
+
+	// give the memory of the small bins back, the pools are not used anymore
+	delete mMemPool_2[k];  mMemPool_2[k] = new MemoryPool<newIndexBin_2,mMemPool_BlockSize>();
+	delete mMemPool_3[k];  mMemPool_3[k] = new MemoryPool<newIndexBin_3,mMemPool_BlockSize>();
+	delete mMemPool_4[k];  mMemPool_4[k] = new MemoryPool<newIndexBin_4,mMemPool_BlockSize>();
+	delete mMemPool_5[k];  mMemPool_5[k] = new MemoryPool<newIndexBin_5,mMemPool_BlockSize>();
+	delete mMemPool_6[k];  mMemPool_6[k] = new MemoryPool<newIndexBin_6,mMemPool_BlockSize>();
+	delete mMemPool_7[k];  mMemPool_7[k] = new MemoryPool<newIndexBin_7,mMemPool_BlockSize>();
+	delete mMemPool_8[k];  mMemPool_8[k] = new MemoryPool<newIndexBin_8,mMemPool_BlockSize>();
+	delete mMemPool_9[k];  mMemPool_9[k] = new MemoryPool<newIndexBin_9,mMemPool_BlockSize>();
+	delete mMemPool_10[k]; mMemPool_10[k] = new MemoryPool<newIndexBin_10,mMemPool_BlockSize>();
+}
+
+void HistogramIndex::BuildInlineBinTables(){
+
+	cout << "build inline bin tables ..." << endl;
+	mInlineTables.resize(mInverseIndex.size());
+	for (unsigned k = 0; k < mInverseIndex.size(); k++){
+		uint64_t numKeys = mInverseIndex[k].size();
+		uint64_t inlineKeys = 0;
+		mInlineTables[k].Init(numKeys);
+		for (typename indexSingleTy::const_iterator itBin = mInverseIndex[k].begin(); itBin!=mInverseIndex[k].end(); itBin++){
+			mInlineTables[k].Insert(itBin->first, itBin->second);
+			if (itBin->second[0] <= InlineBinTable::INLINE_LABELS)
+				inlineKeys++;
+		}
+		ReleaseInverseIndex(k);
+		ostringstream stats;
+		stats << "sub index " << k+1 << " : " << numKeys << " keys, " << inlineKeys << " inline bins, ";
+		stats << setprecision(1) << fixed << mInlineTables[k].GetMemory()/1048576.0 << " MB" << endl;
+		cout << stats.str();
+	}
+}
+
+void HistogramIndex::BuildHierarchicalIndex(const vector<binKeyTy>& labelGroups, binKeyTy numGroups){
+
+	cout << "build hierarchical index ..." << endl;
+
+	mLabelGroups = labelGroups;
+	mNumGroups = numGroups;
+	mCoarseIndex.resize(mInverseIndex.size());
+	mGroupIndex.assign(mNumGroups, setIndexTy(mInverseIndex.size()));
+
+	uint64_t numKeys = 0;
+	uint64_t binEntries = 0;
+	uint64_t groupKeys = 0;
+	vector<binKeyTy> groups;
+	vector<binKeyTy> labels;
+	for (unsigned k = 0; k < mInverseIndex.size(); k++){
+		mCoarseIndex[k].max_load_factor(0.9);
+		mCoarseIndex[k].set_resizing_parameters(0.0,0.9);
+		mCoarseIndex[k].rehash(mInverseIndex[k].size());
+		for (typename indexSingleTy::const_iterator itBin = mInverseIndex[k].begin(); itBin!=mInverseIndex[k].end(); itBin++){
+			const binKeyTy* bin = itBin->second;
+			// group set of the bin as [n,groups]
+			groups.assign(1, 0);
+			for (unsigned i=1;i<=bin[0];++i)
+				groups.push_back(mLabelGroups[bin[i]]);
+			sort(groups.begin()+1, groups.end());
+			groups.erase(unique(groups.begin()+1, groups.end()), groups.end());
+			groups[0] = groups.size()-1;
+			mCoarseIndex[k][itBin->first] = InternLabelSet(&groups[0]);
+
+			for (unsigned g=1;g<=groups[0];++g){
+				labels.assign(1, 0);
+				for (unsigned i=1;i<=bin[0];++i)
+					if (mLabelGroups[bin[i]] == groups[g])
+						labels.push_back(bin[i]);
+				labels[0] = labels.size()-1;
+				mGroupIndex[groups[g]-1][k][itBin->first] = InternLabelSet(&labels[0]);
+			}
+			numKeys++;
+			binEntries += bin[0];
+			groupKeys += groups[0];
+		}
+		ReleaseInverseIndex(k);
+	}
+
+	ostringstream stats;
+	stats << "hierarchical index: " << mNumGroups << " groups, " << numKeys << " keys, ";
+	stats << setprecision(2) << fixed << (double)groupKeys/std::max((uint64_t)1,numKeys) << " groups per key" << endl;
+	cout << stats.str();
+	FinishLabelSetIndex(numKeys, binEntries);
+}
+
+void HistogramIndex::FinishLabelSetIndex(uint64_t numKeys, uint64_t binEntries){
+
+	// the lookup table is only needed while label sets are added
+	spp::sparse_hash_map<uint64_t, unsigned>().swap(mLabelSetIds);
+	if (mCompressLabelSets)
+		mPackedLabelSets.resize(mPackedLabelSets.size() + PostingListCodec::PADDING, 0);
+
+	// bins: per key a pointer and [n,labels], label sets: per key an id, per set an offset and [n,labels]
+	double binMB = (numKeys*(sizeof(binKeyTy*)+sizeof(binKeyTy)) + binEntries*sizeof(binKeyTy))/1048576.0;
+	double setMB = (numKeys*sizeof(unsigned) + mLabelSetOffsets.size()*sizeof(uint64_t) + mLabelSetPool.size()*sizeof(binKeyTy) + mPackedLabelSets.size())/1048576.0;
+	ostringstream stats;
+	stats << (mCompressLabelSets ? "compressed " : "") << "label sets: " << mLabelSetOffsets.size() << " distinct sets for " << numKeys << " keys, ";
+	stats << setprecision(1) << fixed << binMB << " MB -> " << setMB << " MB (without hash tables)" << endl;
+	if (mCompressLabelSets)
+		stats << "label set decoder: " << (PostingListCodec::IsVectorised() ? "SSSE3" : "scalar") << endl;
+	cout << stats.str();
+
+	if (mUseQuotientKeys)
+		BuildQuotientKeyTables();
+}
+
+void HistogramIndex::BuildQuotientKeyTables(){
+
+	cout << "build quotient key tables ..." << endl;
+	mKeyTables.resize(mSetIndex.size());
+	for (unsigned k = 0; k < mSetIndex.size(); k++){
+		vector<QuotientKeyTable::entryT> entries(mSetIndex[k].begin(), mSetIndex[k].end());
+		setIndexSingleTy().swap(mSetIndex[k]);
+		sort(entries.begin(), entries.end());
+		mKeyTables[k].Build(entries, mpParameters->mHashBitSize);
+
+		// hash table: key and value per entry at the maximal load factor, without the sparsepp bitmaps
+		double hashMB = entries.size()*2*sizeof(unsigned)/0.9/1048576.0;
+		ostringstream stats;
+		stats << "sub index " << k+1 << " : " << entries.size() << " keys, " << mKeyTables[k].GetRemainderBits() << " remainder bits, ";
+		stats << setprecision(1) << fixed << hashMB << " MB -> " << mKeyTables[k].GetMemory()/1048576.0 << " MB" << endl;
+		cout << stats.str();
+	}
+}
+
+void HistogramIndex::BuildKeyFilters(const indexTy& index){
+
+	mKeyFilters.assign(index.size(), BlockedBloomFilter());
+	for (unsigned hf = 0; hf < index.size(); hf++){
+		mKeyFilters[hf].Init(index[hf].size(), mKeyFilterBits);
+		for (typename indexSingleTy::const_iterator itBin = index[hf].begin(); itBin!=index[hf].end(); itBin++)
+			mKeyFilters[hf].Add(itBin->first);
+	}
+}
@@ -15,6 +15,7 @@
 #include "sparsepp.h"
 
 #include "MemoryPool.h"
+#include "FlatIndex.h"
 
 using namespace std;
 
@@ -23,6 +24,9 @@ class MinHashEncoder {
 
 public:
 	const unsigned MAXUNSIGNED = (2 << 31)-1 ;
+	// large windows of sequences to classify, independent of the chunks so that the windows of a
+	// split sequence (see splitSeqs) and of the library/server are the same as in one chunk
+	static const unsigned CLASSIFY_LARGE_WINDOW = 1000000;
 
 	enum signatureActionE {
 		INDEX, INDEX_SIGCACHE, CLASSIFY
@@ -57,6 +61,11 @@ public:
 		Data::BEDdataP	dataBED;
 		unsigned lastMetaIdx;
 		ogzstream* out_results_fh;
+		// CLASSIFY: a long sequence may be split over several chunks, otherwise all its windows are in one chunk
+		bool splitSeqs;
+		// CLASSIFY: instances carry the input record of their sequence, records of sequences
+		// without any window are passed to SkippedSequences
+		bool keepRecords;
 	};
 
 	typedef SeqFileS 							SeqFileT;
@@ -77,6 +86,14 @@ public:
 		vector<vector<unsigned> > minHashes;
 		bool			rc;
 		SeqFileP 	seqFile;
+		// part of a sequence that is split over several chunks (see splitSeqs), 0 and true if not split
+		unsigned		part;
+		bool			lastPart;
+		// input record (header line and sequence as in the file) if the SeqFile keeps records
+		std::shared_ptr<const string> record;
+		// hash of seq for the read cache, 0 until an index computes it (the indexes of a run share it)
+		uint64_t		seqHash;
+		instanceS():part(0),lastPart(true),seqHash(0){};
 	};
 
 	typedef instanceS InstanceT;
@@ -140,6 +157,8 @@ public:
 	void              worker_Seq2Signature_SingleWin(int numWorkers, unsigned id);
 	void 					finisher_IndexUpdate(unsigned id, unsigned min, unsigned max);
 	virtual void			finishUpdate(ChunkP& myData, unsigned& min, unsigned& max) {};
+	// records of the sequences of a chunk that are too short for a window (keepRecords only)
+	virtual void			SkippedSequences(SeqFileP& myData, vector<std::shared_ptr<const string> >& aRecords) {};
 
 	vector<unsigned>		HashFuncNSPDK(const string& aString, unsigned& aStart, unsigned& aMinRadius, unsigned& aMaxRadius, unsigned aBitMask);
 	void 					HashSignatureHelper();
@@ -220,7 +239,16 @@ class HistogramIndex : public MinHashEncoder
 
 public:
 
-	const unsigned INDEX_FORMAT_VERSION = 2;
+	const unsigned INDEX_FORMAT_VERSION = 3;
+	// version 2 files have no flags and are still readable
+	const unsigned INDEX_FORMAT_VERSION_LEGACY = 2;
+
+	// bits of the flags word in the index header
+	enum indexFlagsE {
+		INDEX_FLAG_SORTED_KEYS = 1,	// keys of each sub index are written in increasing order
+		INDEX_FLAG_PRUNED = 2,			// uninformative keys were removed, thresholds follow the flags word
+		INDEX_FLAG_KEY_FILTER = 4		// a Bloom filter per sub index follows the sub indices, bits per key follow the thresholds
+	};
 
 	typedef uint16_t binKeyTy;
 	typedef binKeyTy* indexBinTy;
@@ -284,6 +312,78 @@ public:
 
 	binKeyTy mHistogramSize;
 	indexTy mInverseIndex;
+	unsigned mIndexFlags;
+
+	// read-only index mapped from a shared memory segment, replaces mInverseIndex if attached
+	SharedIndexSegment mSharedSegment;
+	FlatIndex mFlatIndex;
+
+	// out-of-core index build (--max_build_memory): each index update thread collects
+	// packed (hf,key,label) entries, sorted runs are spilled to files and merged at the end
+	struct spillBufferS {
+		vector<uint64_t> entries;
+		vector<string> runFiles;
+	};
+	// statistics of build-time pruning (--prune_max_bin_size, --prune_max_entropy),
+	// query cost of a key is estimated as numLabels^2, i.e. bins of many labels are scanned more often
+	struct pruneStatsS {
+		uint64_t bins, entries, cost;
+		uint64_t prunedBins, prunedEntries, prunedCost;
+	};
+	unsigned mPruneBinSize;
+	pruneStatsS mPruneStats;
+
+	// key count estimation for presizing the sub indices during build: each index update
+	// thread samples the first chunks, the distinct keys of the sample are extrapolated to all bases
+	// by D(n) = D_s*(n/n_s)^b (Heaps' law), b is fitted from the keys at half and at the end of the sample
+	vector<HyperLogLog> mKeyEstimators;
+	vector<uint64_t> mSampleBases;
+	vector<uint64_t> mHalfSampleBases;
+	vector<double> mHalfSampleKeys;
+	vector<char> mSampling;
+	vector<uint64_t> mEstimatedKeys;
+	uint64_t mSampleTarget;
+	uint64_t mTotalBases;
+
+	// open addressing tables with inline bins (--index_inline_bins), replace mInverseIndex after loading
+	bool mUseInlineBins;
+	vector<InlineBinTable> mInlineTables;
+
+	// Bloom filter of the keys of each sub index (--index_bloom_bits)
+	vector<BlockedBloomFilter> mKeyFilters;
+	unsigned mKeyFilterBits;
+
+	// label set index (--index_label_sets): each distinct label set is stored once in mLabelSetPool
+	// as [n,label_1,..,label_n], the sub indices map keys to the 32 bit id of their label set
+	typedef spp::sparse_hash_map<unsigned, unsigned> setIndexSingleTy;
+	typedef vector<setIndexSingleTy> setIndexTy;
+	bool mUseLabelSets;
+	setIndexTy mSetIndex;
+	vector<binKeyTy> mLabelSetPool;
+	vector<uint64_t> mLabelSetOffsets;
+	// --index_compress_bins: label sets are kept as PostingListCodec streams in mPackedLabelSets instead
+	bool mCompressLabelSets;
+	vector<uint8_t> mPackedLabelSets;
+	unsigned mMaxLabelSetSize;
+	// --index_quotient_keys: the finished sub indices of the label set index are replaced by quotient tables
+	bool mUseQuotientKeys;
+	vector<QuotientKeyTable> mKeyTables;
+	// hash of label set -> id, collisions are resolved by probing the next hash value
+	spp::sparse_hash_map<uint64_t, unsigned> mLabelSetIds;
+
+	// hierarchical index (--index_hierarchy): labels are grouped (e.g. species by genus), the coarse index
+	// maps keys to the set of their groups, the fine index of each group maps its keys to the labels within
+	// the group, both refer to label sets; replaces mInverseIndex after loading
+	bool mUseHierarchy;
+	vector<binKeyTy> mLabelGroups;		// label -> group, both 1-based
+	binKeyTy mNumGroups;
+	setIndexTy mCoarseIndex;
+	vector<setIndexTy> mGroupIndex;
+
+	bool mSpillIndex;
+	string mSpillPrefix;
+	uint64_t mSpillCapacity;
+	vector<spillBufferS> mSpillBuffers;
 
 	/////////////////////////////
 	// member functions
@@ -291,18 +391,104 @@ public:
 
 	// constructor
 	HistogramIndex(Parameters* apParameters, Data* apData)
-	:MinHashEncoder(apParameters,apData) { };
+	:MinHashEncoder(apParameters,apData), mIndexFlags(0), mPruneBinSize(0), mSampleTarget(0), mTotalBases(0), mUseInlineBins(false), mKeyFilterBits(0), mUseLabelSets(false), mCompressLabelSets(false), mMaxLabelSetSize(0), mUseQuotientKeys(false), mUseHierarchy(false), mNumGroups(0), mSpillIndex(false), mSpillCapacity(0) { };
 
 	void		InitInverseIndex();
+	void		InitKeyEstimation(uint64_t totalBases);
+	void		EstimateKeys(ChunkP& myData, unsigned& min, unsigned& max);
+	void		PrintKeyEstimation();
 	binKeyTy	GetHistogramSize();
 	void		SetHistogramSize(binKeyTy size);
 	void		UpdateInverseIndex(const vector<unsigned>& aSignature, const unsigned& aIndex);
 	void		UpdateInverseIndex(const vector<unsigned>& aSignature, const unsigned& aIndex, unsigned& min, unsigned& max);
 	void 		UpdateInverseIndex(const unsigned& key, const unsigned& aIndex, unsigned& k);
 	//void		ComputeHistogram(const vector<unsigned>& aSignature, std::valarray<double>& hist, unsigned& emptyBins);
-	void 		ComputeHistogram(const vector<vector<unsigned>>& aSigArray, std::valarray<double>& hist, vector<unsigned>& emptyBins);
+	// adds the hits of the windows sigBegin..sigEnd-1 to hist, emptyBins are the sub indices without hit per window
+	void 		ComputeHistogram(const vector<vector<unsigned>>& aSigArray, SparseHistogram& hist, vector<unsigned>& emptyBins, unsigned sigBegin = 0, unsigned sigEnd = std::numeric_limits<unsigned>::max());
+	// batch query (--batch_query): the (sub index,key) queries of all instances begin..end are radix sorted,
+	// each distinct key is looked up once and the index is accessed in increasing key order;
+	// hits are the labels (one entry per hit) of each instance
+	struct batchQueryS {
+		uint64_t key;	// sub index << 32 | key
+		unsigned instance;
+		unsigned sig;
+	};
+	void		ComputeHistogramBatch(ChunkT::iterator begin, ChunkT::iterator end, vector<vector<unsigned> >& hits, vector<vector<unsigned> >& emptyBins);
+	// lookups are done in groups, the memory of the next group of keys is prefetched meanwhile;
+	// the first access of a lookup is prefetched, i.e. the key filter block or the table slot/bucket
+	static const unsigned PREFETCH_GROUP = 8;
+	inline void PrefetchKey(unsigned hf, unsigned key) const {
+		if (mKeyFilters.size() != 0)
+			mKeyFilters[hf].Prefetch(key);
+		else if (mUseInlineBins)
+			mInlineTables[hf].Prefetch(key);
+		else if (mFlatIndex.IsAttached())
+			mFlatIndex.Prefetch(hf,key);
+		else if (mUseQuotientKeys)
+			mKeyTables[hf].Prefetch(key);
+	};
+	// prefetches keys begin.. of the group, but not beyond end (the end of the queried windows)
+	inline void PrefetchGroup(unsigned hf, const vector<unsigned>& keys, unsigned begin, unsigned end) const {
+		end = std::min(end, begin + PREFETCH_GROUP);
+		for (unsigned i = begin; i < end; ++i)
+			PrefetchKey(hf, keys[i]);
+	};
+	// coarse-to-fine query of the hierarchical index, only the best groups are looked up in their fine index
+	void		ComputeHistogramHierarchical(const vector<vector<unsigned>>& aSigArray, SparseHistogram& hist, vector<unsigned>& emptyBins, unsigned sigBegin, unsigned sigEnd);
+	// true if the first numHashFunctions sub indices have at least minHits hits over all windows
+	bool		ScreenInstance(const vector<vector<unsigned>>& aSigArray, unsigned numHashFunctions, unsigned minHits);
+	// labels of key in sub index hf for any index layout, buf is used for compressed label sets
+	const binKeyTy* LookupBin(unsigned hf, unsigned key, unsigned& size, vector<binKeyTy>& buf) const;
+	void		writeIndexHeader(ostream &out);
+	bool		readIndexHeader(istream &in);
 	void		writeBinaryIndex2(ostream &out, const indexTy& index);
 	bool		readBinaryIndex2(string filename, indexTy& index);
+	void		PublishSharedIndex(const string& name, bool hugePages);
+	void		MergeIndexFiles(const vector<string>& filenames, ostream &out);
+	void		DeleteBin(binKeyTy* bin, unsigned k);
+	bool		InitPruning();
+	// returns true if a bin with numBinEntries labels is removed from the index
+	inline bool	PruneBin(unsigned numBinEntries){
+		uint64_t cost = (uint64_t)numBinEntries*numBinEntries;
+		mPruneStats.bins++;
+		mPruneStats.entries += numBinEntries;
+		mPruneStats.cost += cost;
+		if (mPruneBinSize == 0 || numBinEntries <= mPruneBinSize)
+			return false;
+		mPruneStats.prunedBins++;
+		mPruneStats.prunedEntries += numBinEntries;
+		mPruneStats.prunedCost += cost;
+		return true;
+	};
+	void		PruneInverseIndex();
+	void		PrintPruneStats();
+	void		BuildKeyFilters(const indexTy& index);
+	void		InitSpillIndex(const string& prefix);
+	// buf identifies the calling index update thread, i.e. its first hash function
+	inline void	SpillInverseIndex(const unsigned& key, const unsigned& aIndex, unsigned& k, unsigned& buf){
+		if ( key != MAXUNSIGNED && key != 0) {
+			vector<uint64_t>& entries = mSpillBuffers[buf].entries;
+			entries.push_back(((uint64_t)k << 48) | ((uint64_t)key << 16) | (uint64_t)aIndex);
+			if (entries.size() >= mSpillCapacity)
+				FlushSpillBuffer(buf);
+		}
+	};
+	void		FlushSpillBuffer(unsigned buf);
+	void		MergeSpilledIndex(ostream &out);
+	bool		AttachSharedIndex(const string& name);
+	unsigned	InternLabelSet(const binKeyTy* bin);
+	inline const binKeyTy* GetLabelSet(unsigned id) const { return &mLabelSetPool[mLabelSetOffsets[id]]; };
+	inline unsigned GetLabelSetSize(unsigned id) const {
+		if (mCompressLabelSets)
+			return PostingListCodec::DecodeSize(&mPackedLabelSets[mLabelSetOffsets[id]]);
+		return mLabelSetPool[mLabelSetOffsets[id]];
+	};
+	void		BuildLabelSetIndex();
+	void		FinishLabelSetIndex(uint64_t numKeys, uint64_t binEntries);
+	void		BuildQuotientKeyTables();
+	void		ReleaseInverseIndex(unsigned k);
+	void		BuildInlineBinTables();
+	void		BuildHierarchicalIndex(const vector<binKeyTy>& labelGroups, binKeyTy numGroups);
 
 	// destructor
 	virtual ~HistogramIndex(){
@@ -188,6 +188,10 @@ void Parameters::SetupOptions() {
 		param.mCloseValuesList.push_back("CLUSTER");
 		param.mCloseValuesList.push_back("CLASSIFY");
 		param.mCloseValuesList.push_back("TEST");
+		param.mCloseValuesList.push_back("PUBLISH_INDEX");
+		param.mCloseValuesList.push_back("MERGE_INDEX");
+		param.mCloseValuesList.push_back("UPDATE_INDEX");
+		param.mCloseValuesList.push_back("SERVE");
 
 
 		mOptionList.insert(make_pair(param.mLongSwitch, param));
@@ -195,12 +199,20 @@ void Parameters::SetupOptions() {
 		mActionOptionList.insert(make_pair(CLUSTER, vector<ParameterType*>()));
 		mActionOptionList.insert(make_pair(CLASSIFY, vector<ParameterType*>()));
 		mActionOptionList.insert(make_pair(TEST, vector<ParameterType*>()));
+		mActionOptionList.insert(make_pair(PUBLISH_INDEX, vector<ParameterType*>()));
+		mActionOptionList.insert(make_pair(MERGE_INDEX, vector<ParameterType*>()));
+		mActionOptionList.insert(make_pair(UPDATE_INDEX, vector<ParameterType*>()));
+		mActionOptionList.insert(make_pair(SERVE, vector<ParameterType*>()));
 
 		string txt;
 		txt = "Neighborhood Subgraph Pairwise Decomposition Kernel see: Fabrizio Costa, Kurt De Grave, ''Fast Neighborhood Subgraph Pairwise Distance Kernel'', Proceedings of the 27th International Conference on Machine Learning (ICML-2010), Haifa, Israel, 2010.";
 		mActionReferences.insert(make_pair(CLUSTER, txt));
 		mActionReferences.insert(make_pair(CLASSIFY, txt));
 		mActionReferences.insert(make_pair(TEST, txt));
+		mActionReferences.insert(make_pair(PUBLISH_INDEX, txt));
+		mActionReferences.insert(make_pair(MERGE_INDEX, txt));
+		mActionReferences.insert(make_pair(UPDATE_INDEX, txt));
+		mActionReferences.insert(make_pair(SERVE, txt));
 		//Summaries
 		txt = "Extract explicit feature representation using graph kernel decomposition.\n"
 				"And nearest neighbors are efficiently identified with a locality sensitive hashing technique.";
@@ -209,6 +221,14 @@ void Parameters::SetupOptions() {
 		mActionSummary.insert(make_pair(CLASSIFY, txt));
 		txt = "Clustering/classification test for development.";
 		mActionSummary.insert(make_pair(TEST, txt));
+		txt = "Builds/reads the MinHash histogram index and publishes it as named shared memory segment; concurrent CLASSIFY runs attach to it with --shm_name.";
+		mActionSummary.insert(make_pair(PUBLISH_INDEX, txt));
+		txt = "Merges index files (*.bhi) that were built with the same index parameters, e.g. for different genome subsets, into a single index file.";
+		mActionSummary.insert(make_pair(MERGE_INDEX, txt));
+		txt = "Adds new regions/genomes to an existing index file (<index_bed>.bhi) without rebuilding it; only the new regions are hashed.";
+		mActionSummary.insert(make_pair(UPDATE_INDEX, txt));
+		txt = "Loads/attaches the index once and classifies batches of sequences sent by clients over a Unix domain socket (--serve_socket).";
+		mActionSummary.insert(make_pair(SERVE, txt));
 	}
 	{
 		ParameterType param;
@@ -233,6 +253,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX, MERGE_INDEX, UPDATE_INDEX});
 	}
 	{
 		ParameterType param;
@@ -351,6 +372,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX});
 	}
 	{
 		ParameterType param;
@@ -375,6 +397,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX});
 	}
 	{
 		ParameterType param;
@@ -399,6 +422,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX});
 	}
 	{
 		ParameterType param;
@@ -423,6 +447,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX, MERGE_INDEX, UPDATE_INDEX});
 	}
 	{
 		ParameterType param;
@@ -462,6 +487,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX});
 	}
 	{
 		ParameterType param;
@@ -505,6 +531,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX});
 	}
 	{
 		ParameterType param;
@@ -543,6 +570,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX});
 	}
 	//--------------------------------------
 	{
@@ -568,6 +596,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX});
 	}
 	{
 		ParameterType param;
@@ -592,6 +621,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX, UPDATE_INDEX});
 	}
 	{
 		ParameterType param;
@@ -616,6 +646,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX, UPDATE_INDEX});
 	}
 	{
 		ParameterType param;
@@ -635,6 +666,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX});
 	}
 	{
 		ParameterType param;
@@ -673,6 +705,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX});
 	}
 	{
 		ParameterType param;
@@ -692,6 +725,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX});
 	}
 
 	{
@@ -717,6 +751,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX});
 	}
 	{
 		ParameterType param;
@@ -741,12 +776,13 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX});
 	}
 	{
 		ParameterType param;
 		param.mShortSwitch = "";
 		param.mLongSwitch = "index_bed";
-		param.mShortDescription = "MinHash histogram reverse index is build from this data; The 4th col of BED entry denotes the bin in the histogram";
+		param.mShortDescription = "MinHash histogram reverse index is build from this data; The 4th col of BED entry denotes the bin in the histogram. For action CLASSIFY it can be given several times to classify against several indexes with identical hashing parameters in one pass.";
 		param.mTypeCode = STRING;
 		param.mValue = "";
 		mOptionList.insert(make_pair(param.mLongSwitch, param));
@@ -760,12 +796,13 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX, UPDATE_INDEX});
 	}
 	{
 		ParameterType param;
 		param.mShortSwitch = "";
 		param.mLongSwitch = "index_seqs";
-		param.mShortDescription = "MinHash histogram reverse index is build from this data; contains the corresponding seqs for regions given in BED file (--index_bed)";
+		param.mShortDescription = "MinHash histogram reverse index is build from this data; contains the corresponding seqs for regions given in BED file (--index_bed). Given once for all or once per --index_bed.";
 		param.mTypeCode = STRING;
 		param.mValue = "";
 		mOptionList.insert(make_pair(param.mLongSwitch, param));
@@ -779,6 +816,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX, UPDATE_INDEX});
 	}
 	{
 		ParameterType param;
@@ -812,6 +850,7 @@ void Parameters::SetupOptions() {
 			ParameterType& p = mOptionList[param.mLongSwitch];
 			vec.push_back(&p);
 		}
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX});
 	}
 	{
 		ParameterType param;
@@ -851,6 +890,328 @@ void Parameters::SetupOptions() {
 			vec.push_back(&p);
 		}
 	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "shm_name";
+		param.mShortDescription = "Name of the shared memory segment that holds a published index (-a PUBLISH_INDEX). For action CLASSIFY the index is attached from that segment instead of being built/read.";
+		param.mTypeCode = STRING;
+		param.mValue = "";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY, PUBLISH_INDEX});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "shm_huge_pages";
+		param.mShortDescription = "Request (transparent) huge pages for the published shared memory index.";
+		param.mTypeCode = FLAG;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "shm_remove";
+		param.mShortDescription = "Remove the published shared memory index --shm_name. While processes are attached the index is only retired (no new attachments) and the last of them removes it; attachments of crashed processes are reclaimed.";
+		param.mTypeCode = FLAG;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "shm_force";
+		param.mShortDescription = "With --shm_remove: remove the index at once even if processes are attached; attached processes keep their mapping until they finish.";
+		param.mTypeCode = FLAG;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {PUBLISH_INDEX});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "max_build_memory";
+		param.mShortDescription = "Memory budget in MB for building the index; 0 builds the index in memory. Otherwise sorted runs of index entries are written to temporary files next to the index file and merged into the final index file. Chunks in the signature queues are not part of this budget.";
+		param.mTypeCode = INTEGER;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY, PUBLISH_INDEX});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "index_merge_files";
+		param.mShortDescription = "Comma separated list of index files (*.bhi) to merge; all indices must be built with the same index parameters. Labels with the same name are merged.";
+		param.mTypeCode = STRING;
+		param.mValue = "";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {MERGE_INDEX});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "index_merge_output";
+		param.mShortDescription = "File name of the merged index file (written to --output_directory_path).";
+		param.mTypeCode = STRING;
+		param.mValue = "merged.bhi";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {MERGE_INDEX});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "index_update_bed";
+		param.mShortDescription = "BED file with the new regions that are added to the index <index_bed>.bhi; labels already in the index keep their id.";
+		param.mTypeCode = STRING;
+		param.mValue = "";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {UPDATE_INDEX});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "index_update_seqs";
+		param.mShortDescription = "Sequences for the regions in --index_update_bed; default is --index_seqs.";
+		param.mTypeCode = STRING;
+		param.mValue = "";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {UPDATE_INDEX});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "index_update_output";
+		param.mShortDescription = "File name of the updated index (written to --output_directory_path); default replaces <index_bed>.bhi.";
+		param.mTypeCode = STRING;
+		param.mValue = "";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {UPDATE_INDEX});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "prune_max_bin_size";
+		param.mShortDescription = "Index build: remove keys that occur in more than this number of labels (0 = off); such keys hardly discriminate between labels but cost memory and query time. The thresholds are stored in the index.";
+		param.mTypeCode = INTEGER;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY, PUBLISH_INDEX, MERGE_INDEX, UPDATE_INDEX});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "prune_max_entropy";
+		param.mShortDescription = "Index build: remove keys whose normalized label-set entropy log2(#labels)/log2(histogram size) is larger than this value (1 = off).";
+		param.mTypeCode = REAL;
+		param.mValue = "1";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY, PUBLISH_INDEX, MERGE_INDEX, UPDATE_INDEX});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "index_label_sets";
+		param.mShortDescription = "Store each distinct label set of the index only once, keys refer to it by a 32 bit id (less memory for redundant references).";
+		param.mTypeCode = FLAG;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "index_compress_bins";
+		param.mShortDescription = "Keep the label sets of the index delta and bit-packed encoded in memory (implies --index_label_sets).";
+		param.mTypeCode = FLAG;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "index_scalar_decoder";
+		param.mShortDescription = "Decode compressed label sets (--index_compress_bins) with the scalar decoder even if the CPU supports the vectorised (SSSE3) one.";
+		param.mTypeCode = FLAG;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "index_quotient_keys";
+		param.mShortDescription = "Store the keys of the index as quotient/remainder in compact sorted tables (implies --index_label_sets).";
+		param.mTypeCode = FLAG;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "index_bloom_bits";
+		param.mShortDescription = "Index build: bits per key of a blocked Bloom filter per sub index that is stored in the index; lookups of keys rejected by the filter skip the hash table (0 = off).";
+		param.mTypeCode = INTEGER;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY, PUBLISH_INDEX});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "index_inline_bins";
+		param.mShortDescription = "Convert the index into open addressing tables that store bins of up to 5 labels inline next to the key (no label set options).";
+		param.mTypeCode = FLAG;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "batch_query";
+		param.mShortDescription = "Query the index for chunks of sequences at once: the keys of all windows are sorted and each distinct key is looked up once, in increasing key order.";
+		param.mTypeCode = FLAG;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "screen_hash_functions";
+		param.mShortDescription = "Two-tier query: probe only the first n sub indices (hash functions) of a sequence first, all sub indices are only queried if this screen has at least --screen_min_hits hits (0 = off).";
+		param.mTypeCode = INTEGER;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "screen_min_hits";
+		param.mShortDescription = "Minimal number of hits of the screen (--screen_hash_functions) in a single window of a sequence.";
+		param.mTypeCode = INTEGER;
+		param.mValue = "1";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "index_hierarchy";
+		param.mShortDescription = "Hierarchical index: file with lines <LABEL> <GROUP> (e.g. species and genus), reads are classified against the groups first and only the best groups are refined to their labels. Labels without group form a group of their own.";
+		param.mTypeCode = STRING;
+		param.mValue = "";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "hierarchy_group_fraction";
+		param.mShortDescription = "Groups of the hierarchical index (--index_hierarchy) with at least this fraction of the hits of the best group are refined to their labels (0 = all groups with hits).";
+		param.mTypeCode = REAL;
+		param.mValue = "1.0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "early_stop_windows";
+		param.mShortDescription = "Sequential classification of long sequences: windows are evaluated in blocks of n windows, no more windows are evaluated once the leading label is significantly better than the runner-up (0 = off).";
+		param.mTypeCode = INTEGER;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "early_stop_error";
+		param.mShortDescription = "Error probability of the sequential test of --early_stop_windows.";
+		param.mTypeCode = REAL;
+		param.mValue = "0.001";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "early_stop_hit_prob";
+		param.mShortDescription = "Sequential test of --early_stop_windows: probability that a window won by the leading label or the runner-up (most hits of the window) is won by the true label (0.5 < p < 1).";
+		param.mTypeCode = REAL;
+		param.mValue = "0.6";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "abundance_output";
+		param.mShortDescription = "Write a summary of the classification to <input file>.abundance.tab: per label the number of unique and ambiguous reads and the normalized abundance.";
+		param.mTypeCode = FLAG;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "no_read_output";
+		param.mShortDescription = "Do not write the per-read results file <input file>.classified.tab.gz (e.g. with --abundance_output).";
+		param.mTypeCode = FLAG;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "serve_socket";
+		param.mShortDescription = "Path of the Unix domain socket on which -a SERVE accepts classification requests.";
+		param.mTypeCode = STRING;
+		param.mValue = "edenseq.sock";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {SERVE});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "serve_queue_size";
+		param.mShortDescription = "Maximal number of queued requests of -a SERVE; clients are not read from while the queue is full.";
+		param.mTypeCode = POSITIVE_INTEGER;
+		param.mValue = "16";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {SERVE});
+	}
+
+	// SERVE takes the classification options, the sequences come from the clients
+	{
+		vector<ParameterType*>& vec = mActionOptionList[SERVE];
+		const vector<ParameterType*>& classify = mActionOptionList[CLASSIFY];
+		for (unsigned i = 0; i < classify.size(); i++){
+			if (classify[i]->mShortSwitch != "i")
+				vec.push_back(classify[i]);
+		}
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "bin_output";
+		param.mShortDescription = "Write the classified sequences (FASTA) into one file <input file>.bin.<category>.fa.gz per category: unclassified, ambiguous (best labels of different categories) and the categories of --bin_rules or, without rules, one per label.";
+		param.mTypeCode = FLAG;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "bin_rules";
+		param.mShortDescription = "File with label rules for --bin_output, one '<label name> <category>' per line (e.g. host, target); labels without a rule are binned as other.";
+		param.mTypeCode = STRING;
+		param.mValue = "";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "bin_no_compression";
+		param.mShortDescription = "Write uncompressed bin files (--bin_output).";
+		param.mTypeCode = FLAG;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+	{
+		ParameterType param;
+		param.mLongSwitch = "read_cache_size";
+		param.mShortDescription = "Cache the classification of up to this many distinct sequences (keyed by a 64 bit hash of both strands), duplicates skip hashing and index queries; 0 disables the cache.";
+		param.mTypeCode = POSITIVE_INTEGER;
+		param.mValue = "0";
+		mOptionList.insert(make_pair(param.mLongSwitch, param));
+		AddToActions(param.mLongSwitch, {CLASSIFY});
+	}
+}
+
+void Parameters::AddToActions(const string& aLongSwitch, const vector<ActionType>& aActions) {
+	ParameterType& p = mOptionList[aLongSwitch];
+	for (unsigned i = 0; i < aActions.size(); ++i)
+		mActionOptionList[aActions[i]].push_back(&p);
 }
 
 void Parameters::Usage(string aCommandName, string aCompactOrExtended) {
@@ -905,6 +1266,28 @@ void Parameters::Init(int argc, const char** argv) {
 	mVerbose = false;
 	mNoIndexCacheFile = false;
 	mWriteApproxNeighbors = false;
+	mShmHugePages = false;
+	mShmRemove = false;
+	mShmForce = false;
+	mIndexLabelSets = false;
+	mIndexCompressBins = false;
+	mIndexScalarDecoder = false;
+	mIndexQuotientKeys = false;
+	mIndexInlineBins = false;
+	mBatchQuery = false;
+	mAbundanceOutput = false;
+	mNoReadOutput = false;
+	mBinOutput = false;
+	mBinNoCompression = false;
+	// --index_bed/--index_seqs may be given several times, the first one is the primary index
+	mIndexBedFiles.clear();
+	mIndexSeqFiles.clear();
+	for (unsigned i = 0; i + 1 < options.size(); i++) {
+		if (options[i] == "--index_bed")
+			mIndexBedFiles.push_back(options[i + 1]);
+		if (options[i] == "--index_seqs")
+			mIndexSeqFiles.push_back(options[i + 1]);
+	}
 	//set the data members of Parameters according to user choice
 	for (map<string, ParameterType>::iterator it = mOptionList.begin(); it != mOptionList.end(); ++it) {
 		ParameterType& param = it->second;
@@ -917,6 +1300,32 @@ void Parameters::Init(int argc, const char** argv) {
 				mWriteApproxNeighbors = true;
 			if (param.mLongSwitch == "no_index_cache_file")
 				mNoIndexCacheFile = true;
+			if (param.mLongSwitch == "shm_huge_pages")
+				mShmHugePages = true;
+			if (param.mLongSwitch == "shm_remove")
+				mShmRemove = true;
+			if (param.mLongSwitch == "shm_force")
+				mShmForce = true;
+			if (param.mLongSwitch == "index_label_sets")
+				mIndexLabelSets = true;
+			if (param.mLongSwitch == "index_compress_bins")
+				mIndexCompressBins = true;
+			if (param.mLongSwitch == "index_scalar_decoder")
+				mIndexScalarDecoder = true;
+			if (param.mLongSwitch == "index_quotient_keys")
+				mIndexQuotientKeys = true;
+			if (param.mLongSwitch == "index_inline_bins")
+				mIndexInlineBins = true;
+			if (param.mLongSwitch == "batch_query")
+				mBatchQuery = true;
+			if (param.mLongSwitch == "abundance_output")
+				mAbundanceOutput = true;
+			if (param.mLongSwitch == "no_read_output")
+				mNoReadOutput = true;
+			if (param.mLongSwitch == "bin_output")
+				mBinOutput = true;
+			if (param.mLongSwitch == "bin_no_compression")
+				mBinNoCompression = true;
 		}
 
 
@@ -953,9 +1362,9 @@ void Parameters::Init(int argc, const char** argv) {
 		if (param.mLongSwitch == "numIndexThreads")
 			mNumIndexThreads = stream_cast<unsigned>(param.mValue);
 		if (param.mLongSwitch == "index_bed")
-			mIndexBedFile = param.mValue;
+			mIndexBedFile = mIndexBedFiles.size() > 0 ? mIndexBedFiles[0] : param.mValue;
 		if (param.mLongSwitch == "index_seqs")
-			mIndexSeqFile = param.mValue;
+			mIndexSeqFile = mIndexSeqFiles.size() > 0 ? mIndexSeqFiles[0] : param.mValue;
 		if (param.mLongSwitch == "seq_shift")
 			mSeqShift = stream_cast<unsigned>(param.mValue);
 		if (param.mLongSwitch == "index_seq_shift")
@@ -974,6 +1383,48 @@ void Parameters::Init(int argc, const char** argv) {
 			mDenseCenterNamesFile = param.mValue;
 		if (param.mLongSwitch == "output_type")
 			mOutputType = param.mValue;
+		if (param.mLongSwitch == "shm_name")
+			mShmName = param.mValue;
+		if (param.mLongSwitch == "max_build_memory")
+			mMaxBuildMemory = stream_cast<unsigned>(param.mValue);
+		if (param.mLongSwitch == "index_merge_files")
+			mIndexMergeFiles = param.mValue;
+		if (param.mLongSwitch == "index_merge_output")
+			mIndexMergeOutput = param.mValue;
+		if (param.mLongSwitch == "index_update_bed")
+			mIndexUpdateBedFile = param.mValue;
+		if (param.mLongSwitch == "index_update_seqs")
+			mIndexUpdateSeqFile = param.mValue;
+		if (param.mLongSwitch == "index_update_output")
+			mIndexUpdateOutput = param.mValue;
+		if (param.mLongSwitch == "prune_max_bin_size")
+			mPruneMaxBinSize = stream_cast<unsigned>(param.mValue);
+		if (param.mLongSwitch == "prune_max_entropy")
+			mPruneMaxEntropy = stream_cast<double>(param.mValue);
+		if (param.mLongSwitch == "index_bloom_bits")
+			mIndexBloomBits = stream_cast<unsigned>(param.mValue);
+		if (param.mLongSwitch == "screen_hash_functions")
+			mScreenHashFunctions = stream_cast<unsigned>(param.mValue);
+		if (param.mLongSwitch == "screen_min_hits")
+			mScreenMinHits = stream_cast<unsigned>(param.mValue);
+		if (param.mLongSwitch == "index_hierarchy")
+			mIndexHierarchy = param.mValue;
+		if (param.mLongSwitch == "hierarchy_group_fraction")
+			mHierarchyGroupFraction = stream_cast<double>(param.mValue);
+		if (param.mLongSwitch == "early_stop_windows")
+			mEarlyStopWindows = stream_cast<unsigned>(param.mValue);
+		if (param.mLongSwitch == "early_stop_error")
+			mEarlyStopError = stream_cast<double>(param.mValue);
+		if (param.mLongSwitch == "early_stop_hit_prob")
+			mEarlyStopHitProb = stream_cast<double>(param.mValue);
+		if (param.mLongSwitch == "serve_socket")
+			mServeSocket = param.mValue;
+		if (param.mLongSwitch == "serve_queue_size")
+			mServeQueueSize = stream_cast<unsigned>(param.mValue);
+		if (param.mLongSwitch == "bin_rules")
+			mBinRules = param.mValue;
+		if (param.mLongSwitch == "read_cache_size")
+			mReadCacheSize = stream_cast<unsigned>(param.mValue);
 	}
 
 	//convert action string to action code
@@ -985,6 +1436,14 @@ void Parameters::Init(int argc, const char** argv) {
 		mActionCode = CLASSIFY;
 	else if (mAction == "TEST")
 		mActionCode = TEST;
+	else if (mAction == "PUBLISH_INDEX")
+		mActionCode = PUBLISH_INDEX;
+	else if (mAction == "MERGE_INDEX")
+		mActionCode = MERGE_INDEX;
+	else if (mAction == "UPDATE_INDEX")
+		mActionCode = UPDATE_INDEX;
+	else if (mAction == "SERVE")
+		mActionCode = SERVE;
 	else
 		throw range_error("ERROR Parameters::Init: Unrecognized action: <" + mAction + ">");
 
@@ -1025,6 +1484,32 @@ void Parameters::Init(int argc, const char** argv) {
 	}
 
 	//check that set parameters are compatible
-	if (mInputDataFileName == "")
+	if (mInputDataFileName == "" && mActionCode != PUBLISH_INDEX && mActionCode != MERGE_INDEX && mActionCode != UPDATE_INDEX && mActionCode != SERVE)
 		throw range_error("ERROR Parameters::Init: -i <input data file name> is missing.");
+	if (mActionCode == PUBLISH_INDEX && mShmName == "")
+		throw range_error("ERROR Parameters::Init: --shm_name <shared memory name> is missing.");
+	if (mActionCode == UPDATE_INDEX && mIndexUpdateBedFile == "")
+		throw range_error("ERROR Parameters::Init: --index_update_bed <BED file with new regions> is missing.");
+	if (mScreenHashFunctions > 0 && mBatchQuery)
+		throw range_error("ERROR Parameters::Init: --screen_hash_functions cannot be combined with --batch_query.");
+	if (mNoReadOutput && !mAbundanceOutput && !mBinOutput && mActionCode == CLASSIFY)
+		throw range_error("ERROR Parameters::Init: --no_read_output needs --abundance_output or --bin_output.");
+	if (mEarlyStopWindows > 0 && mBatchQuery)
+		throw range_error("ERROR Parameters::Init: --early_stop_windows cannot be combined with --batch_query.");
+	if (mEarlyStopWindows > 0 && (mEarlyStopError <= 0 || mEarlyStopError >= 1 || mEarlyStopHitProb <= 0.5 || mEarlyStopHitProb >= 1))
+		throw range_error("ERROR Parameters::Init: --early_stop_error has to be in (0,1) and --early_stop_hit_prob in (0.5,1).");
+	if (mIndexBedFiles.size() > 1 && mActionCode != CLASSIFY)
+		throw range_error("ERROR Parameters::Init: several --index_bed are only supported for -a CLASSIFY.");
+	if (mIndexBedFiles.size() > 1 && mShmName != "")
+		throw range_error("ERROR Parameters::Init: several --index_bed cannot be combined with --shm_name.");
+	if (mIndexSeqFiles.size() > 1 && mIndexSeqFiles.size() != mIndexBedFiles.size())
+		throw range_error("ERROR Parameters::Init: --index_seqs has to be given once or once per --index_bed.");
+	if (mActionCode == SERVE && (mAbundanceOutput || mNoReadOutput || mBinOutput))
+		throw range_error("ERROR Parameters::Init: --abundance_output, --no_read_output and --bin_output are not available for -a SERVE.");
+	if (mReadCacheSize > 0 && mBatchQuery)
+		throw range_error("ERROR Parameters::Init: --read_cache_size cannot be combined with --batch_query.");
+	if (mBinOutput && mSeqWindow != 0 && mSeqShift > mSeqWindow)
+		throw range_error("ERROR Parameters::Init: --bin_output needs --seq_shift <= --seq_window to write complete sequences.");
+	if (mActionCode == SERVE && (mServeSocket == "" || mServeQueueSize == 0))
+		throw range_error("ERROR Parameters::Init: -a SERVE needs a --serve_socket path and a --serve_queue_size > 0.");
 }
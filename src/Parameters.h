@@ -14,7 +14,7 @@ const string CITATIONS = "For the NSPDK graph kernels see Fabrizio Costa, Kurt D
 
 
 enum ActionType {
-	NULL_ACTION, CLUSTER, CLASSIFY, TEST
+	NULL_ACTION, CLUSTER, CLASSIFY, TEST, PUBLISH_INDEX, MERGE_INDEX, UPDATE_INDEX, SERVE
 };
 
 enum InputFileType {
@@ -93,10 +93,42 @@ public:
 	// MetaGenome
 	string mIndexBedFile;
 	string mIndexSeqFile;
+	vector<string> mIndexBedFiles;	// all --index_bed, mIndexBedFile is the first
+	vector<string> mIndexSeqFiles;
 	bool mNoIndexCacheFile;
 	unsigned mSeqWindow;
 	unsigned mIndexSeqShift;
 	unsigned mSeqShift;
+	unsigned mMaxBuildMemory;
+	string mIndexMergeFiles;
+	string mIndexMergeOutput;
+	string mIndexUpdateBedFile;
+	string mIndexUpdateSeqFile;
+	string mIndexUpdateOutput;
+	unsigned mPruneMaxBinSize;
+	double mPruneMaxEntropy;
+	unsigned mIndexBloomBits;
+	bool mIndexLabelSets;
+	bool mIndexCompressBins;
+	bool mIndexScalarDecoder;
+	bool mIndexQuotientKeys;
+	bool mIndexInlineBins;
+	bool mBatchQuery;
+	unsigned mScreenHashFunctions;
+	unsigned mScreenMinHits;
+	string mIndexHierarchy;
+	double mHierarchyGroupFraction;
+	unsigned mEarlyStopWindows;
+	double mEarlyStopError;
+	double mEarlyStopHitProb;
+	bool mAbundanceOutput;
+	bool mNoReadOutput;
+	string mServeSocket;
+	unsigned mServeQueueSize;
+	bool mBinOutput;
+	string mBinRules;
+	bool mBinNoCompression;
+	unsigned mReadCacheSize;
 
 	unsigned mSeqClip;
 	unsigned mMinRadius;
@@ -106,9 +138,17 @@ public:
 	string mOutputType;
 	OutputType mOutputTypeCode;
 
+	// shared memory index
+	string mShmName;
+	bool mShmHugePages;
+	bool mShmRemove;
+	bool mShmForce;
+
 public:
 	Parameters();
 	void SetupOptions();
+	// lists the option in the usage of the given actions
+	void AddToActions(const string& aLongSwitch, const vector<ActionType>& aActions);
 	void Usage(string aCommandName, string aCompactOrExtended);
 	void Init(int argc, const char** argv);
 };
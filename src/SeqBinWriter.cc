@@ -0,0 +1,239 @@
+/*
+ * SeqBinWriter.cc
+ *
+ *  FASTA output of the classified sequences per category (--bin_output)
+ */
+
+#include "SeqBinWriter.h"
+#include "gzstream.h"
+
+SeqBinWriter::SeqBinWriter(Parameters* apParameters):mpParameters(apParameters){
+}
+
+SeqBinWriter::~SeqBinWriter(){
+	for (unsigned i = 0; i < mFiles.size(); i++)
+		delete mFiles[i];
+}
+
+// the category is part of the file name
+static string GetCategoryName(const string& aName){
+	string name = aName;
+	for (unsigned i = 0; i < name.size(); i++){
+		if (!isalnum(name[i]) && name[i] != '_' && name[i] != '-' && name[i] != '.')
+			name[i] = '_';
+	}
+	return name;
+}
+
+unsigned SeqBinWriter::AddCategory(const string& aName){
+
+	string name = GetCategoryName(aName);
+	map<string, unsigned>::iterator it = mCategoryIds.find(name);
+	if (it != mCategoryIds.end())
+		return it->second;
+	mCategoryIds.insert(make_pair(name, mCategoryNames.size()));
+	mCategoryNames.push_back(name);
+	return mCategoryNames.size()-1;
+}
+
+void SeqBinWriter::Init(const string& aFilePrefix, const map<string, uint>& aFeature2IndexValue, unsigned aNumLabels){
+
+	mFilePrefix = aFilePrefix;
+	AddCategory("unclassified");
+	AddCategory("ambiguous");
+
+	mLabelCategory.assign(aNumLabels, UNCLASSIFIED);
+	if (mpParameters->mBinRules != ""){
+		// rules: <label name> <category>, labels without rule are binned as other
+		map<string, string> rules;
+		igzstream fin;
+		fin.open(mpParameters->mBinRules.c_str());
+		if (!fin)
+			throw range_error("ERROR SeqBinWriter::Init: cannot open bin rules file " + mpParameters->mBinRules);
+		string line;
+		while (getline(fin, line)){
+			if (line.size() == 0 || line[0] == '#')
+				continue;
+			istringstream ss(line);
+			string label, category;
+			ss >> label >> category;
+			if (category == "")
+				throw range_error("ERROR SeqBinWriter::Init: expect <label name> <category> in bin rules file, found: " + line);
+			const string name = GetCategoryName(category);
+			if (name == "unclassified" || name == "ambiguous" || name == "other")
+				throw range_error("ERROR SeqBinWriter::Init: category " + category + " is reserved, use another category in bin rules file: " + line);
+			rules[label] = category;
+		}
+		fin.close();
+
+		unsigned other = AddCategory("other");
+		for (map<string, uint>::const_iterator it = aFeature2IndexValue.begin(); it != aFeature2IndexValue.end(); ++it){
+			if (it->second == 0 || it->second > aNumLabels)
+				continue;
+			map<string, string>::iterator rule = rules.find(it->first);
+			mLabelCategory[it->second-1] = (rule != rules.end()) ? AddCategory(rule->second) : other;
+		}
+	} else {
+		// labels named like a reserved category or like another label after sanitizing get a prefix
+		for (map<string, uint>::const_iterator it = aFeature2IndexValue.begin(); it != aFeature2IndexValue.end(); ++it){
+			if (it->second == 0 || it->second > aNumLabels)
+				continue;
+			string name = GetCategoryName(it->first);
+			while (mCategoryIds.count(name) > 0)
+				name = "label_" + name;
+			mLabelCategory[it->second-1] = AddCategory(name);
+		}
+	}
+
+	mCategorySeqs.assign(mCategoryNames.size(), 0);
+	mFiles.assign(mCategoryNames.size(), nullptr);
+	mReopen.assign(mCategoryNames.size(), 0);
+
+	const unsigned numWriters = std::min((unsigned)mCategoryNames.size(), 4U);
+	for (unsigned i = 0; i < numWriters; i++)
+		mQueues.push_back(std::make_shared<writeQueueS>());
+	for (unsigned i = 0; i < numWriters; i++)
+		mWriters.push_back(std::thread(&SeqBinWriter::worker_Write, this, i));
+
+	cout << "Write sequences into " << mCategoryNames.size() << " bins " << mpParameters->mDirectoryPath << mFilePrefix << ".bin.<category>.fa" << (mpParameters->mBinNoCompression ? "" : ".gz") << endl;
+}
+
+void SeqBinWriter::Write(vector<BinBufferT>& aBuffers){
+
+	// called by the results finisher and by the file reader (sequences without windows)
+	vector<writeJobT> jobs;
+	{
+		std::lock_guard<std::mutex> lk(mut_write);
+		for (unsigned c = 0; c < aBuffers.size(); c++){
+			if (aBuffers[c].numSeqs == 0)
+				continue;
+			mCategorySeqs[c] += aBuffers[c].numSeqs;
+			std::shared_ptr<string> records = std::make_shared<string>();
+			records->swap(aBuffers[c].records);
+			aBuffers[c].numSeqs = 0;
+			jobs.push_back(make_pair(c, records));
+		}
+	}
+
+	// after an error the records are dropped, Close reports the error
+	{
+		std::lock_guard<std::mutex> lkError(mut_error);
+		if (mError)
+			return;
+	}
+	// a full queue only blocks this caller, not the other one
+	for (unsigned i = 0; i < jobs.size(); i++)
+		Push(jobs[i].first % mQueues.size(), jobs[i]);
+}
+
+void SeqBinWriter::Push(unsigned aWriter, const writeJobT& aJob){
+
+	writeQueueS& queue = *mQueues[aWriter];
+	{
+		std::unique_lock<std::mutex> lk(queue.mut);
+		queue.cv_push.wait(lk, [&]{ return queue.jobs.size() < MAX_QUEUED_JOBS; });
+		queue.jobs.push_back(aJob);
+	}
+	queue.cv_pop.notify_one();
+}
+
+void SeqBinWriter::OpenFile(unsigned aCategory){
+
+	string filename = mpParameters->mDirectoryPath + mFilePrefix + ".bin." + mCategoryNames[aCategory] + ".fa";
+	std::ios::openmode mode = mReopen[aCategory] ? (std::ios::out | std::ios::app) : std::ios::out;
+	std::ostream* out;
+	if (mpParameters->mBinNoCompression)
+		out = new ofstream(filename.c_str(), mode);
+	else {
+		// the stream state of the opening constructor is reset by std::ostream, open afterwards
+		ogzstream* gzOut = new ogzstream();
+		gzOut->open((filename + ".gz").c_str(), mode);
+		out = gzOut;
+	}
+	if (!out->good()){
+		delete out;
+		throw range_error("ERROR SeqBinWriter: cannot write bin file " + filename);
+	}
+	mFiles[aCategory] = out;
+	mReopen[aCategory] = 1;
+}
+
+void SeqBinWriter::CloseFile(unsigned aCategory){
+
+	if (mpParameters->mBinNoCompression)
+		static_cast<ofstream*>(mFiles[aCategory])->close();
+	else
+		static_cast<ogzstream*>(mFiles[aCategory])->close();
+	delete mFiles[aCategory];
+	mFiles[aCategory] = nullptr;
+}
+
+void SeqBinWriter::worker_Write(unsigned id){
+
+	// open files of this writer, the least recently used first
+	deque<unsigned> open;
+	const unsigned maxOpen = std::max(1U, MAX_OPEN_FILES / (unsigned)mQueues.size());
+	bool failed = false;
+
+	writeQueueS& queue = *mQueues[id];
+	while (true){
+		writeJobT job;
+		{
+			std::unique_lock<std::mutex> lk(queue.mut);
+			queue.cv_pop.wait(lk, [&]{ return !queue.jobs.empty(); });
+			job = queue.jobs.front();
+			queue.jobs.pop_front();
+		}
+		queue.cv_push.notify_one();
+		if (!job.second)
+			break;
+		if (failed)
+			continue;
+
+		// errors are kept for Close, an exception must not leave the thread
+		try {
+			deque<unsigned>::iterator it = std::find(open.begin(), open.end(), job.first);
+			if (it != open.end()){
+				open.erase(it);
+			} else {
+				if (open.size() >= maxOpen){
+					CloseFile(open.front());
+					open.pop_front();
+				}
+				OpenFile(job.first);
+			}
+			open.push_back(job.first);
+
+			std::ostream* out = mFiles[job.first];
+			out->write(job.second->data(), job.second->size());
+			if (!out->good())
+				throw range_error("ERROR SeqBinWriter: cannot write bin file for category " + mCategoryNames[job.first]);
+		} catch (...) {
+			std::lock_guard<std::mutex> lk(mut_error);
+			if (!mError)
+				mError = std::current_exception();
+			failed = true;
+		}
+	}
+
+	for (unsigned i = 0; i < open.size(); i++)
+		CloseFile(open[i]);
+}
+
+void SeqBinWriter::Close(){
+
+	for (unsigned i = 0; i < mQueues.size(); i++)
+		Push(i, make_pair(0U, std::shared_ptr<string>()));
+	for (unsigned i = 0; i < mWriters.size(); i++)
+		mWriters[i].join();
+	mWriters.clear();
+
+	if (mError)
+		std::rethrow_exception(mError);
+
+	cout << endl << "Sequence bins:" << endl;
+	for (unsigned c = 0; c < mCategoryNames.size(); c++){
+		if (mCategorySeqs[c] > 0 || c == UNCLASSIFIED)
+			cout << setw(30) << std::right << mCategoryNames[c] << "  " << mCategorySeqs[c] << endl;
+	}
+}
@@ -0,0 +1,82 @@
+/*
+ * SeqBinWriter.h
+ *
+ *  Writes the classified sequences into one FASTA file per category (--bin_output),
+ *  e.g. host/target/unclassified from label rules (--bin_rules) or one file per label.
+ *  At most MAX_OPEN_FILES bin files are open at a time, a file that was closed is
+ *  reopened for appending (compressed files get another gzip member).
+ */
+
+#ifndef SEQBINWRITER_H_
+#define SEQBINWRITER_H_
+
+#include "Utility.h"
+#include "Parameters.h"
+
+class SeqBinWriter {
+
+public:
+	// records of one category collected by a worker for one chunk
+	struct binBufferS {
+		string records;
+		unsigned numSeqs;
+		binBufferS():numSeqs(0){};
+	};
+	typedef binBufferS BinBufferT;
+
+	static const unsigned UNCLASSIFIED = 0;
+	static const unsigned AMBIGUOUS = 1;
+	static const unsigned MAX_OPEN_FILES = 64;
+
+	SeqBinWriter(Parameters* apParameters);
+	~SeqBinWriter();
+
+	// categories of the labels (1-based index values) from --bin_rules, otherwise one category per label
+	void 			Init(const string& aFilePrefix, const map<string, uint>& aFeature2IndexValue, unsigned aNumLabels);
+	unsigned 	GetNumCategories() const { return mCategoryNames.size(); };
+	inline unsigned GetLabelCategory(unsigned aLabel) const { return mLabelCategory[aLabel-1]; };
+
+	// hands the buffers of a chunk to the writer threads, the buffers are emptied
+	void 			Write(vector<BinBufferT>& aBuffers);
+	// writes all pending records, closes the files and prints the number of sequences per category;
+	// throws the first error of the writer threads
+	void 			Close();
+
+private:
+	typedef pair<unsigned, std::shared_ptr<string> > writeJobT;
+
+	// jobs of a writer thread; Push blocks while MAX_QUEUED_JOBS jobs are waiting, i.e. writers
+	// that fall behind slow down the results
+	static const unsigned MAX_QUEUED_JOBS = 256;
+	struct writeQueueS {
+		std::mutex mut;
+		std::condition_variable cv_push;
+		std::condition_variable cv_pop;
+		deque<writeJobT> jobs;
+	};
+
+	void 			Push(unsigned aWriter, const writeJobT& aJob);
+	void 			worker_Write(unsigned id);
+	unsigned 	AddCategory(const string& aName);
+	void 			OpenFile(unsigned aCategory);
+	void 			CloseFile(unsigned aCategory);
+
+	Parameters* 	mpParameters;
+	string 			mFilePrefix;
+	vector<unsigned> mLabelCategory;
+	vector<string> mCategoryNames;
+	map<string, unsigned> mCategoryIds;
+	vector<uint64_t> mCategorySeqs;
+	std::mutex 		mut_write;
+	// first error of a writer thread
+	std::mutex 		mut_error;
+	std::exception_ptr mError;
+
+	// categories are distributed over the writer threads, a file is opened with its first record
+	vector<std::ostream*> mFiles;
+	vector<char> 	mReopen;
+	vector<std::shared_ptr<writeQueueS> > mQueues;
+	vector<std::thread> mWriters;
+};
+
+#endif /* SEQBINWRITER_H_ */
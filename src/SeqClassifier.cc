@@ -0,0 +1,298 @@
+/*
+ * SeqClassifier.cc
+ *
+ *  Library interface (libedenseq), C++ classifier and the C interface of edenseq.h
+ */
+
+#include "SeqClassifier.h"
+#include "edenseq.h"
+
+#include <exception>
+
+SeqClassifier::SeqClassifier(const vector<string>& aOptions):mpParameters(&mParameters),mpData(&mData),mpManager(nullptr){
+
+	// the sequences are passed to Classify, -i only satisfies the option check
+	vector<const char*> argv;
+	argv.push_back("libedenseq");
+	argv.push_back("-a");
+	argv.push_back("CLASSIFY");
+	argv.push_back("-i");
+	argv.push_back("memory");
+	for (unsigned i = 0; i < aOptions.size(); i++)
+		argv.push_back(aOptions[i].c_str());
+
+	mParameters.Init(argv.size(), &argv[0]);
+	srand(mParameters.mRandomSeed);
+	mData.Init(&mParameters);
+	omp_set_num_threads(mParameters.mNumThreads);
+
+	Init();
+}
+
+SeqClassifier::SeqClassifier(Parameters* apParameters, Data* apData):mpParameters(apParameters),mpData(apData),mpManager(nullptr){
+	Init();
+}
+
+void SeqClassifier::Init(){
+
+	if (mpParameters->mActionCode != CLASSIFY && mpParameters->mActionCode != SERVE)
+		throw range_error("ERROR SeqClassifier: only actions CLASSIFY and SERVE are supported!");
+	if (mpParameters->mIndexBedFiles.size() > 1)
+		throw range_error("ERROR SeqClassifier: only one --index_bed is supported!");
+
+	mNumWorkers = std::thread::hardware_concurrency();
+	if (mpParameters->mNumThreads > 0)
+		mNumWorkers = mpParameters->mNumThreads;
+	mNumWorkers = std::max(1U, mNumWorkers);
+
+	mpManager = new SeqClassifyManager(mpParameters, mpData);
+	try {
+		mpManager->CheckParameters();
+		mpManager->LoadIndex();
+		mpManager->HashSignatureHelper();
+	} catch (...) {
+		delete mpManager;
+		throw;
+	}
+
+	mpManager->wobbleDist = 1;
+	mpManager->mNumSequences = 0;
+	mpManager->mClassifiedInstances = 0;
+	mpManager->mScreenedInstances = 0;
+	mpManager->mScreenCandidates = 0;
+	mpManager->mEarlyStopped = 0;
+	mpManager->mEvaluatedWindows = 0;
+	mpManager->mTotalWindows = 0;
+	mpManager->metaHist.resize(mpManager->GetHistogramSize(), 0);
+	mpManager->metaHistNum.resize(mpManager->GetHistogramSize(), 0);
+
+	mSeqSet = std::make_shared<SeqClassifyManager::SeqFileT>();
+	mSeqSet->filetype            = FASTA;
+	mSeqSet->groupGraphsBy       = SeqClassifyManager::SEQ_NUM;
+	mSeqSet->checkUniqueSeqNames = false;
+	mSeqSet->signatureAction	  = SeqClassifyManager::CLASSIFY;
+	mSeqSet->strandType          = SeqClassifyManager::FR;
+	mSeqSet->lastMetaIdx			  = 0;
+	mSeqSet->out_results_fh      = nullptr;
+
+	mLabelNames.assign(mpManager->GetHistogramSize(), "");
+	for (map<string, uint>::iterator it = mpManager->mFeature2IndexValue.begin(); it != mpManager->mFeature2IndexValue.end(); ++it){
+		if (it->second >= 1 && it->second <= mLabelNames.size())
+			mLabelNames[it->second-1] = it->first;
+	}
+}
+
+SeqClassifier::~SeqClassifier(){
+	delete mpManager;
+}
+
+bool SeqClassifier::AddInstances(const string& aName, const string& aSeq, unsigned aIdx, SeqClassifyManager::ChunkT& oChunk){
+
+	string currSeq = aSeq;
+	std::transform(currSeq.begin(), currSeq.end(), currSeq.begin(), ::toupper);
+
+	// long sequences are split into large windows as by the file reader
+	const unsigned largeBuff = SeqClassifyManager::CLASSIFY_LARGE_WINDOW;
+	unsigned pos = 0;
+	bool lastSeqGr = false;
+	bool added = false;
+	while (!lastSeqGr){
+		SeqClassifyManager::InstanceT myInstance;
+		mpData->GetNextLargeWinFromSeq(currSeq, pos, lastSeqGr, myInstance.seq, largeBuff, mpParameters->mSeqWindow, mpParameters->mSeqShift);
+
+		// require at least a seq of maximal feature span
+		if (myInstance.seq.size() < mpParameters->mRadius + mpParameters->mDistance + 1)
+			break;
+
+		myInstance.seqFile = mSeqSet;
+		myInstance.name = aName;
+		myInstance.idx = aIdx;
+		myInstance.pos = pos;
+		myInstance.rc = false;
+
+		SeqClassifyManager::InstanceT myInstanceRC;
+		myInstanceRC.seqFile = mSeqSet;
+		myInstanceRC.name = aName;
+		myInstanceRC.idx = aIdx;
+		myInstanceRC.pos = pos;
+		myInstanceRC.rc = true;
+		mpData->GetRevComplSeq(myInstance.seq, myInstanceRC.seq);
+
+		oChunk.push_back(myInstance);
+		oChunk.push_back(myInstanceRC);
+		added = true;
+	}
+	return added;
+}
+
+void SeqClassifier::ClassifyChunks(const vector<pair<string,string> >& aSeqs, bool aKeepReads, vector<SeqClassifyManager::ResultChunkP>& oResultChunks, vector<vector<unsigned> >& oSeqIds){
+
+	// consecutive sequences form one chunk per worker
+	const unsigned numChunks = std::min((unsigned)aSeqs.size(), mNumWorkers);
+	oResultChunks.assign(numChunks, SeqClassifyManager::ResultChunkP());
+	oSeqIds.assign(numChunks, vector<unsigned>());
+	std::exception_ptr error = nullptr;
+
+#pragma omp parallel for schedule(dynamic,1) num_threads(mNumWorkers)
+	for (unsigned c = 0; c < numChunks; c++){
+		try {
+			const unsigned begin = (uint64_t)aSeqs.size()*c/numChunks;
+			const unsigned end = (uint64_t)aSeqs.size()*(c+1)/numChunks;
+
+			SeqClassifyManager::ChunkP myChunk = std::make_shared<SeqClassifyManager::ChunkT>();
+			// input position of each classified sequence
+			for (unsigned i = begin; i < end; i++){
+				if (AddInstances(aSeqs[i].first, aSeqs[i].second, i, *myChunk))
+					oSeqIds[c].push_back(i);
+			}
+
+			for (SeqClassifyManager::ChunkT::iterator j = myChunk->begin(); j != myChunk->end(); j++)
+				mpManager->sliding_window_minhash(j->minHashes, j->seq, mpParameters->mMinRadius, mpParameters->mRadius, mpParameters->mMinDistance, mpParameters->mDistance, mpParameters->mSeqWindow, mpParameters->mSeqShift);
+
+			oResultChunks[c] = std::make_shared<SeqClassifyManager::ResultChunkT>();
+			oResultChunks[c]->keepReads = aKeepReads;
+			if (!myChunk->empty())
+				mpManager->finishUpdate(myChunk, oResultChunks[c], nullptr);
+		} catch (...) {
+#pragma omp critical
+			error = std::current_exception();
+		}
+	}
+
+	if (error != nullptr)
+		std::rethrow_exception(error);
+}
+
+void SeqClassifier::Classify(const vector<pair<string,string> >& aSeqs, vector<ReadResultT>& oResults){
+
+	oResults.assign(aSeqs.size(), ReadResultT());
+	for (unsigned i = 0; i < aSeqs.size(); i++){
+		ReadResultT& res = oResults[i];
+		res.name = aSeqs[i].first;
+		res.strand = '.';
+		res.numSigs = res.matchingSigs = res.hits = res.sum = res.max = res.totalSigs = 0;
+	}
+
+	vector<SeqClassifyManager::ResultChunkP> myResultChunks;
+	vector<vector<unsigned> > seqIds;
+	ClassifyChunks(aSeqs, true, myResultChunks, seqIds);
+
+	for (unsigned c = 0; c < myResultChunks.size(); c++){
+		for (unsigned k = 0; k < seqIds[c].size() && k < myResultChunks[c]->reads.size(); k++)
+			std::swap(oResults[seqIds[c][k]], myResultChunks[c]->reads[k]);
+	}
+}
+
+void SeqClassifier::Classify(const vector<pair<string,string> >& aSeqs, string& oLines){
+
+	vector<SeqClassifyManager::ResultChunkP> myResultChunks;
+	vector<vector<unsigned> > seqIds;
+	ClassifyChunks(aSeqs, false, myResultChunks, seqIds);
+
+	oLines.clear();
+	for (unsigned c = 0; c < myResultChunks.size(); c++)
+		oLines += myResultChunks[c]->output;
+}
+
+//------------------------------------------------------------------------------------------------------------------------
+// C interface
+
+struct edenseq_classifier {
+	SeqClassifier* classifier;
+};
+
+static thread_local string edenseq_error;
+
+edenseq_classifier* edenseq_create(int argc, const char** argv){
+	try {
+		vector<string> options(argv, argv + argc);
+		edenseq_classifier* res = new edenseq_classifier;
+		try {
+			res->classifier = new SeqClassifier(options);
+		} catch (...) {
+			delete res;
+			throw;
+		}
+		return res;
+	} catch (exception& e) {
+		edenseq_error = e.what();
+	}
+	return nullptr;
+}
+
+void edenseq_destroy(edenseq_classifier* classifier){
+	if (classifier != nullptr){
+		delete classifier->classifier;
+		delete classifier;
+	}
+}
+
+int edenseq_classify(edenseq_classifier* classifier, size_t n, const char** names, const char** seqs, edenseq_result** results){
+	*results = nullptr;
+	try {
+		vector<pair<string,string> > mySeqs(n);
+		for (size_t i = 0; i < n; i++)
+			mySeqs[i] = make_pair(string(names[i]), string(seqs[i]));
+
+		vector<SeqClassifier::ReadResultT> myResults;
+		classifier->classifier->Classify(mySeqs, myResults);
+
+		// each result owns its name and label arrays
+		edenseq_result* res = new edenseq_result[n];
+		for (size_t i = 0; i < n; i++){
+			const SeqClassifier::ReadResultT& r = myResults[i];
+			char* name = new char[r.name.size()+1];
+			std::copy(r.name.begin(), r.name.end(), name);
+			name[r.name.size()] = '\0';
+			unsigned* labels = new unsigned[r.labels.size()*2+r.bestLabels.size()];
+			for (unsigned k = 0; k < r.labels.size(); k++){
+				labels[k] = r.labels[k].first;
+				labels[r.labels.size()+k] = r.labels[k].second;
+			}
+			std::copy(r.bestLabels.begin(), r.bestLabels.end(), labels+r.labels.size()*2);
+
+			res[i].name = name;
+			res[i].strand = r.strand;
+			res[i].num_sigs = r.numSigs;
+			res[i].matching_sigs = r.matchingSigs;
+			res[i].hits = r.hits;
+			res[i].sum = r.sum;
+			res[i].max = r.max;
+			res[i].total_sigs = r.totalSigs;
+			res[i].num_labels = r.labels.size();
+			res[i].labels = labels;
+			res[i].label_hits = labels+r.labels.size();
+			res[i].num_best_labels = r.bestLabels.size();
+			res[i].best_labels = labels+r.labels.size()*2;
+		}
+		*results = res;
+		return 0;
+	} catch (exception& e) {
+		edenseq_error = e.what();
+	}
+	return -1;
+}
+
+void edenseq_free_results(edenseq_result* results, size_t n){
+	if (results == nullptr)
+		return;
+	for (size_t i = 0; i < n; i++){
+		delete[] results[i].name;
+		delete[] results[i].labels;
+	}
+	delete[] results;
+}
+
+unsigned edenseq_num_labels(const edenseq_classifier* classifier){
+	return classifier->classifier->GetNumLabels();
+}
+
+const char* edenseq_label_name(const edenseq_classifier* classifier, unsigned label){
+	if (label == 0 || label > classifier->classifier->GetNumLabels())
+		return nullptr;
+	return classifier->classifier->GetLabelName(label).c_str();
+}
+
+const char* edenseq_last_error(void){
+	return edenseq_error.c_str();
+}
@@ -0,0 +1,54 @@
+/*
+ * SeqClassifier.h
+ *
+ *  Library interface (libedenseq): the index is loaded once, batches of
+ *  sequences in memory are classified without input or results files.
+ */
+
+#ifndef SEQCLASSIFIER_H_
+#define SEQCLASSIFIER_H_
+
+#include "SeqClassifyManager.h"
+
+class SeqClassifier {
+
+public:
+	typedef SeqClassifyManager::readResultS ReadResultT;
+
+	// options as for -a CLASSIFY on the command line, e.g. {"--index_seqs","g.fa","--index_bed","g.bed","-t","4"},
+	// -a CLASSIFY is implied and -i is not needed; throws range_error if the index cannot be loaded
+	SeqClassifier(const vector<string>& aOptions);
+	// options and data of the calling program (-a SERVE)
+	SeqClassifier(Parameters* apParameters, Data* apData);
+	~SeqClassifier();
+
+	// one result per sequence in input order, sequences shorter than a feature span are reported without windows
+	void 				Classify(const vector<pair<string,string> >& aSeqs, vector<ReadResultT>& oResults);
+	// the result lines as in the results file
+	void 				Classify(const vector<pair<string,string> >& aSeqs, string& oLines);
+
+	// labels are 1-based as in the results file
+	unsigned 		GetNumLabels() const { return mLabelNames.size(); };
+	const string& 	GetLabelName(unsigned aLabel) const { return mLabelNames.at(aLabel-1); };
+
+	Parameters& 	GetParameters() { return *mpParameters; };
+
+private:
+	SeqClassifier(const SeqClassifier&);
+	SeqClassifier& operator=(const SeqClassifier&);
+
+	void 				Init();
+	bool 				AddInstances(const string& aName, const string& aSeq, unsigned aIdx, SeqClassifyManager::ChunkT& oChunk);
+	void 				ClassifyChunks(const vector<pair<string,string> >& aSeqs, bool aKeepReads, vector<SeqClassifyManager::ResultChunkP>& oResultChunks, vector<vector<unsigned> >& oSeqIds);
+
+	Parameters 				mParameters;
+	Data 						mData;
+	Parameters* 			mpParameters;
+	Data* 					mpData;
+	SeqClassifyManager* 	mpManager;
+	SeqClassifyManager::SeqFileP mSeqSet;
+	vector<string> 		mLabelNames;
+	unsigned 				mNumWorkers;
+};
+
+#endif /* SEQCLASSIFIER_H_ */
@@ -9,7 +9,7 @@
 #include "MinHashEncoder.h"
 
 SeqClassifyManager::SeqClassifyManager(Parameters* apParameters, Data* apData):
-HistogramIndex(apParameters,apData)
+HistogramIndex(apParameters,apData), mpBinWriter(nullptr)
 {
 
 }
@@ -22,6 +22,156 @@ void SeqClassifyManager::Exec() {
 
 	CheckParameters();
 
+	LoadIndex();
+	LoadExtraIndexes();
+
+	// do the classification
+	ClassifySeqs();
+
+	pb.PrintElapsed();
+}
+
+void SeqClassifyManager::PublishIndex() {
+
+	ProgressBar pb(1000);
+	cout << endl << SEP << endl << "SHARED INDEX"<< endl << SEP << endl;
+
+	if (mpParameters->mShmRemove){
+		SharedIndexSegment::Remove(mpParameters->mShmName, mpParameters->mShmForce);
+		return;
+	}
+
+	CheckParameters();
+
+	// the published index must not be attached again by this process
+	string shmName = mpParameters->mShmName;
+	mpParameters->mShmName = "";
+	LoadIndex();
+
+	cout << endl << " *** Publish inverse index *** "<< endl << endl;
+	PublishSharedIndex(shmName, mpParameters->mShmHugePages);
+	cout << "Remove it with: -a PUBLISH_INDEX --shm_name " << shmName << " --shm_remove" << endl;
+
+	pb.PrintElapsed();
+}
+
+void SeqClassifyManager::MergeIndex() {
+
+	ProgressBar pb(1000);
+	cout << endl << SEP << endl << "MERGE INDEX"<< endl << SEP << endl;
+
+	vector<string> filenames;
+	istringstream iss(mpParameters->mIndexMergeFiles);
+	string filename;
+	while (getline(iss, filename, ',')){
+		if (filename != "")
+			filenames.push_back(filename);
+	}
+	if (filenames.size() < 2)
+		throw range_error("ERROR --index_merge_files needs at least two comma separated index files (*.bhi)!");
+
+	OutputManager om(mpParameters->mIndexMergeOutput.c_str(), mpParameters->mDirectoryPath);
+	cout << "merged index file : " << om.GetFullPathFileName() << endl;
+	MergeIndexFiles(filenames, om.mOut);
+	om.mOut.close();
+
+	cout << endl << "Read index parameters:"<< endl << endl;
+	PrintIndexParameters();
+	cout << endl << "Use the merged index with a BED file containing the regions of all merged indices, " << endl;
+	cout << "the index file has to be named <index_bed>.bhi" << endl;
+
+	pb.PrintElapsed();
+}
+
+void SeqClassifyManager::UpdateIndex() {
+
+	ProgressBar pb(1000);
+	cout << endl << SEP << endl << "UPDATE INDEX"<< endl << SEP << endl;
+
+	string indexFile = mpParameters->mIndexBedFile+".bhi";
+	cout << endl << " *** Read inverse index *** "<< endl << endl;
+	cout << "inverse index file : " << indexFile << endl << "read index ...";
+
+	if (!readBinaryIndex2(indexFile,mInverseIndex))
+		throw range_error("\nCannot read index from file " + indexFile + "\n");
+	if (mIndexFlags & INDEX_FLAG_PRUNED)
+		throw range_error("ERROR index " + indexFile + " is pruned, only unpruned indices can be updated!");
+
+	cout << "finished! " << endl << endl << "Read index parameters:"<< endl << endl;
+	PrintIndexParameters();
+
+	// new regions are indexed with the shift of the existing index
+	unsigned tmp_shift = mpParameters->mSeqShift;
+	mpParameters->mSeqShift = mpParameters->mIndexSeqShift;
+	CheckParameters();
+
+	// only the new regions are hashed, known labels keep their ids and new labels are appended
+	SeqFileT mySet;
+	mySet.filename            	= mpParameters->mIndexUpdateSeqFile != "" ? mpParameters->mIndexUpdateSeqFile : mpParameters->mIndexSeqFile;
+	mySet.filename_BED		  	= mpParameters->mIndexUpdateBedFile;
+	mySet.filetype            	= FASTA;
+	mySet.checkUniqueSeqNames 	= true;
+	mySet.signatureAction	  	= INDEX;
+	mySet.groupGraphsBy		  	= SEQ_FEATURE;
+	mySet.dataBED             	= mpData->LoadBEDfile(mpParameters->mIndexUpdateBedFile.c_str());
+	mySet.lastMetaIdx			   = GetHistogramSize();
+	mySet.strandType			   = FWD;
+	mIndexDataSet = std::make_shared<SeqFileT>(mySet);
+
+	unsigned numLabels = GetHistogramSize();
+
+	cout << endl << " *** Update inverse index *** "<< endl << endl;
+
+	SeqFilesT myList;
+	myList.push_back(mIndexDataSet);
+
+	wobbleDist = 1;
+	LoadData_Threaded(myList);
+
+	SetHistogramSize(mIndexDataSet->lastMetaIdx);
+	mpParameters->mSeqShift = tmp_shift;
+
+	cout << endl << "labels : " << numLabels << " -> " << GetHistogramSize() << endl;
+	PruneInverseIndex();
+
+	// write the new index version to a temporary file first, an existing index is replaced by rename
+	string outFile;
+	{
+		std::unique_ptr<OutputManager> om;
+		if (mpParameters->mIndexUpdateOutput != "")
+			om.reset(new OutputManager(mpParameters->mIndexUpdateOutput + ".tmp", mpParameters->mDirectoryPath));
+		else
+			om.reset(new OutputManager(indexFile + ".tmp", ""));
+		outFile = om->GetFullPathFileName();
+		outFile = outFile.substr(0,outFile.size()-4);
+		cout << "inverse index file : " << outFile << endl;
+		cout << " write index file ... " << endl;
+		writeBinaryIndex2(om->mOut,mInverseIndex);
+		om->mOut.close();
+		if (!om->mOut.good() || rename((outFile + ".tmp").c_str(), outFile.c_str()) != 0)
+			throw range_error("ERROR cannot write index file " + outFile);
+	}
+
+	cout << endl << "Append the regions of " << mpParameters->mIndexUpdateBedFile << " to the index BED file for the annotation of new labels." << endl;
+
+	pb.PrintElapsed();
+}
+
+void SeqClassifyManager::PrintIndexParameters() {
+	cout << setw(30) << std::right << " hist size  " << GetHistogramSize() << endl;
+	cout << setw(30) << std::right << " hash_bit_size  " << mpParameters->mHashBitSize << endl;
+	cout << setw(30) << std::right << " random_seed  " << mpParameters->mRandomSeed << endl;
+	cout << setw(30) << std::right << " num_hash_functions  " << mpParameters->mNumHashFunctions << endl;
+	cout << setw(30) << std::right << " num_repeat_hash_function  " << mpParameters->mNumRepeatsHashFunction << endl;
+	cout << setw(30) << std::right << " num_hash_shingles  " << mpParameters->mNumHashShingles << endl;
+	cout << setw(30) << std::right << " radius  " << mpParameters->mMinRadius<<".."<<mpParameters->mRadius << endl;
+	cout << setw(30) << std::right << " distance  " << mpParameters->mMinDistance<<".."<<mpParameters->mDistance << endl;
+	cout << setw(30) << std::right << " seq_window  " << mpParameters->mSeqWindow << endl;
+	cout << setw(30) << std::right << " index_seq_shift  " << mpParameters->mIndexSeqShift << " nt" << endl;
+}
+
+void SeqClassifyManager::LoadIndex() {
+
 	SeqFileT mySet;
 	mySet.filename            	= mpParameters->mIndexSeqFile;
 	mySet.filename_BED		  	= mpParameters->mIndexBedFile;
@@ -36,13 +186,43 @@ void SeqClassifyManager::Exec() {
 
 	mIndexDataSet = std::make_shared<SeqFileT>(mySet);
 
+	// a shared index is already compact and read-only
+	mUseLabelSets = (mpParameters->mIndexLabelSets || mpParameters->mIndexCompressBins || mpParameters->mIndexQuotientKeys) && mpParameters->mShmName == "";
+	mCompressLabelSets = mUseLabelSets && mpParameters->mIndexCompressBins;
+	if (mCompressLabelSets)
+		PostingListCodec::SetVectorised(!mpParameters->mIndexScalarDecoder);
+	mUseQuotientKeys = mUseLabelSets && mpParameters->mIndexQuotientKeys;
+	if (mUseLabelSets && mpParameters->mIndexInlineBins)
+		throw range_error("ERROR --index_inline_bins cannot be combined with --index_label_sets, --index_compress_bins or --index_quotient_keys!");
+	mUseInlineBins = mpParameters->mIndexInlineBins && mpParameters->mShmName == "";
+	mUseHierarchy = mpParameters->mIndexHierarchy != "";
+	if (mUseHierarchy && (mUseLabelSets || mpParameters->mIndexInlineBins || mpParameters->mShmName != "" || mpParameters->mBatchQuery))
+		throw range_error("ERROR --index_hierarchy cannot be combined with --index_label_sets, --index_compress_bins, --index_quotient_keys, --index_inline_bins, --shm_name or --batch_query!");
+
 	string indexName = mpParameters->mIndexBedFile;
 	const unsigned pos = mpParameters->mIndexBedFile.find_last_of("/");
 	if (std::string::npos != pos)
 		indexName = mpParameters->mIndexBedFile.substr(pos+1);
+	// the index file is written to the output directory, the runs of --max_build_memory next to it
+	const string indexFileName = OutputManager::GetFullPathFileName(indexName + ".bhi", mpParameters->mDirectoryPath);
 
 	// create/load new inverse MinHash index against that we can classify other sequences
-	if (mpParameters->mNoIndexCacheFile || !std::ifstream(mpParameters->mIndexBedFile+".bhi").good()){
+	if (mpParameters->mShmName != ""){
+		// attach index published by another process (-a PUBLISH_INDEX)
+		mIndexDataSet->filename_index = "SHM:" + mpParameters->mShmName;
+
+		cout << endl << " *** Attach shared inverse index *** "<< endl << endl;
+		bool indexState = AttachSharedIndex(mpParameters->mShmName);
+
+		if (indexState == false)
+			throw range_error("\nCannot read index from shared memory " + mpParameters->mShmName + "\n");
+
+		cout << " Index OK! Format Version "<< INDEX_FORMAT_VERSION << endl << endl << "Read index parameters:"<< endl << endl;
+		PrintIndexParameters();
+
+		CheckParameters();
+
+	} else if (mpParameters->mNoIndexCacheFile || !std::ifstream(mpParameters->mIndexBedFile+".bhi").good()){
 		cout << endl << " *** Creating inverse index *** "<< endl << endl;
 
 		// use desired shift value for index, "LoadData_Threaded" only uses variable mpParameters->mSeqShift
@@ -56,26 +236,71 @@ void SeqClassifyManager::Exec() {
 		myList.push_back(mIndexDataSet);
 
 		wobbleDist = 1;
-		InitInverseIndex();
+		if (mpParameters->mMaxBuildMemory > 0){
+			if (mpParameters->mNoIndexCacheFile)
+				throw range_error("ERROR --max_build_memory writes the index to file and cannot be used with --no_index_cache_file!");
+			// sorted runs are written next to the final index file
+			if (mpParameters->mDirectoryPath != "")
+				mkdir(mpParameters->mDirectoryPath.c_str(), 0777);
+			InitSpillIndex(indexFileName + ".run");
+		} else {
+			InitInverseIndex();
+			// presize the sub indices from a sample instead of growing them by rehashing
+			uint64_t totalBases = 0;
+			for (Data::BEDdataIt it = indexBED->begin(); it != indexBED->end(); it++)
+				totalBases += it->second->END - it->second->START;
+			InitKeyEstimation(totalBases);
+		}
 		LoadData_Threaded(myList);
+		PrintKeyEstimation();
 
 		SetHistogramSize(mIndexDataSet->lastMetaIdx);
 		mpParameters->mSeqShift = tmp_shift;
 
+		// the out-of-core build prunes while merging the runs
+		if (!mSpillIndex)
+			PruneInverseIndex();
+
+		if (mpParameters->mIndexBloomBits > 0){
+			if (mSpillIndex)
+				cout << "Key filters (--index_bloom_bits) are not built with --max_build_memory!" << endl;
+			else {
+				// filters are built when the index is written
+				mKeyFilterBits = mpParameters->mIndexBloomBits;
+				mIndexFlags |= INDEX_FLAG_KEY_FILTER;
+				if (mpParameters->mNoIndexCacheFile)
+					BuildKeyFilters(mInverseIndex);
+			}
+		}
+
 		// write index to file
 		if (!mpParameters->mNoIndexCacheFile){
 			cout << "inverse index file : " << mpParameters->mIndexBedFile+".bhi" << endl;
 			cout << " write index file ... ";
 			OutputManager om((indexName + ".bhi").c_str(), mpParameters->mDirectoryPath);
-			writeBinaryIndex2(om.mOut,mInverseIndex);
+			if (mSpillIndex)
+				MergeSpilledIndex(om.mOut);
+			else
+				writeBinaryIndex2(om.mOut,mInverseIndex);
 			om.mOut.close();
-			mIndexDataSet->filename_index = mpParameters->mDirectoryPath+"/"+indexName+".bhi";
+			mIndexDataSet->filename_index = indexFileName;
 			cout << endl;
+
+			if (mpParameters->mMaxBuildMemory > 0){
+				// out-of-core build only produced the index file, load it for classification
+				cout << "read index ...";
+				if (!readBinaryIndex2(mIndexDataSet->filename_index,mInverseIndex))
+					throw range_error("\nCannot read index from file " + mIndexDataSet->filename_index + "\n");
+			}
 		} else {
 			cout << "Index is NOT saved to file!"<< endl;
 			mIndexDataSet->filename_index = "IN_MEMORY_INDEX_ONLY";
 		}
 
+		// the out-of-core build reads the label sets directly from the index file
+		if (mUseLabelSets && mpParameters->mMaxBuildMemory == 0)
+			BuildLabelSetIndex();
+
 	} else {
 		// read existing index file (*.bhi)
 		mIndexDataSet->filename_index = mpParameters->mIndexBedFile+".bhi";
@@ -90,20 +315,20 @@ void SeqClassifyManager::Exec() {
 
 		cout << "finished! ";
 		cout << " Index OK! Format Version "<< INDEX_FORMAT_VERSION << endl << endl << "Read index parameters:"<< endl << endl;
-		cout << setw(30) << std::right << " hist size  " << GetHistogramSize() << endl;
-		cout << setw(30) << std::right << " hash_bit_size  " << mpParameters->mHashBitSize << endl;
-		cout << setw(30) << std::right << " random_seed  " << mpParameters->mRandomSeed << endl;
-		cout << setw(30) << std::right << " num_hash_functions  " << mpParameters->mNumHashFunctions << endl;
-		cout << setw(30) << std::right << " num_repeat_hash_function  " << mpParameters->mNumRepeatsHashFunction << endl;
-		cout << setw(30) << std::right << " num_hash_shingles  " << mpParameters->mNumHashShingles << endl;
-		cout << setw(30) << std::right << " radius  " << mpParameters->mMinRadius<<".."<<mpParameters->mRadius << endl;
-		cout << setw(30) << std::right << " distance  " << mpParameters->mMinDistance<<".."<<mpParameters->mDistance << endl;
-		cout << setw(30) << std::right << " seq_window  " << mpParameters->mSeqWindow << endl;
-		cout << setw(30) << std::right << " index_seq_shift  " << mpParameters->mIndexSeqShift << " nt" << endl;
+		PrintIndexParameters();
 
 		CheckParameters();
 	}
 
+	if (mUseInlineBins)
+		BuildInlineBinTables();
+
+	if (mUseHierarchy){
+		vector<binKeyTy> labelGroups;
+		binKeyTy numGroups = LoadLabelGroups(mpParameters->mIndexHierarchy, labelGroups);
+		BuildHierarchicalIndex(labelGroups, numGroups);
+	}
+
 	// update IndexValue2Feature map from provided Index BED file
 	for (Data::BEDdataIt it=mIndexDataSet->dataBED->begin(); it!=mIndexDataSet->dataBED->end(); ++it ) {
 		map<string, uint>::iterator It2 = mFeature2IndexValue.find(it->second->NAME);
@@ -129,11 +354,73 @@ void SeqClassifyManager::Exec() {
 			mIndexValue2Feature.insert(make_pair(it->second,myBED));
 		}
 	}
+}
 
-	// do the classification
-	ClassifySeqs();
+void SeqClassifyManager::LoadExtraIndexes() {
+
+	// the signatures of the reads are computed once, all indexes need the hashing parameters of the first one
+	auto hashingParameters = [](const Parameters* p) {
+		return vector<unsigned>{p->mHashBitSize, p->mRandomSeed, p->mRadius, p->mMinRadius, p->mDistance, p->mMinDistance,
+			p->mNumHashFunctions, p->mNumHashShingles, p->mNumRepeatsHashFunction, p->mSeqWindow};
+	};
+	const vector<unsigned> params = hashingParameters(mpParameters);
+
+	for (unsigned i = 1; i < mpParameters->mIndexBedFiles.size(); i++){
+		std::shared_ptr<Parameters> myParameters = std::make_shared<Parameters>(*mpParameters);
+		myParameters->mIndexBedFile = mpParameters->mIndexBedFiles[i];
+		if (mpParameters->mIndexSeqFiles.size() > 1)
+			myParameters->mIndexSeqFile = mpParameters->mIndexSeqFiles[i];
+
+		cout << endl << SEP << endl << "INVERSE INDEX " << i+1 << " " << myParameters->mIndexBedFile << endl << SEP << endl;
+		std::shared_ptr<SeqClassifyManager> myIndex = std::make_shared<SeqClassifyManager>(myParameters.get(), mpData);
+		myIndex->CheckParameters();
+		myIndex->LoadIndex();
+		if (hashingParameters(myParameters.get()) != params)
+			throw range_error("ERROR index " + myParameters->mIndexBedFile + " was built with different hashing parameters than " + mpParameters->mIndexBedFile + "!");
+		myIndex->HashSignatureHelper();
+		myIndex->wobbleDist = 1;
+
+		mExtraParameters.push_back(myParameters);
+		mExtraIndexes.push_back(myIndex);
+	}
+}
 
-	pb.PrintElapsed();
+SeqClassifyManager::binKeyTy SeqClassifyManager::LoadLabelGroups(const string& filename, vector<binKeyTy>& labelGroups){
+
+	igzstream fin;
+	fin.open(filename.c_str());
+	if (!fin)
+		throw range_error("ERROR LoadLabelGroups: Cannot open hierarchy file: " + filename);
+
+	// <LABEL> <GROUP> per line, labels that are not in the index are ignored
+	map<string, binKeyTy> group2idx;
+	labelGroups.assign(GetHistogramSize()+1, 0);
+	string line;
+	while (getline(fin, line)) {
+		istringstream iss(line);
+		string label, group;
+		if (!(iss >> label >> group) || label[0] == '#')
+			continue;
+		map<string, uint>::iterator it = mFeature2IndexValue.find(label);
+		if (it == mFeature2IndexValue.end())
+			continue;
+		if (group2idx.count(group) == 0)
+			group2idx.insert(make_pair(group, (binKeyTy)(group2idx.size()+1)));
+		labelGroups[it->second] = group2idx[group];
+	}
+	fin.close();
+
+	unsigned numGroups = group2idx.size();
+	unsigned ungrouped = 0;
+	for (unsigned i = 1; i < labelGroups.size(); i++){
+		if (labelGroups[i] == 0){
+			labelGroups[i] = ++numGroups;
+			ungrouped++;
+		}
+	}
+	cout << "label hierarchy : " << filename << ", " << group2idx.size() << " groups";
+	cout << ", " << ungrouped << " labels without group" << endl;
+	return numGroups;
 }
 
 void SeqClassifyManager::worker_Classify(int numWorkers, unsigned id){
@@ -164,12 +451,21 @@ void SeqClassifyManager::worker_Classify(int numWorkers, unsigned id){
 			//
 			//			}
 
-			for (ChunkT::iterator j=myData->begin(); j!=myData->end();j++){
+			// with --read_cache_size the signatures are computed in finishUpdate for sequences that are not cached
+			for (ChunkT::iterator j=myData->begin(); j!=myData->end() && !mReadCache.Enabled();j++){
 				sliding_window_minhash(j->minHashes,j->seq,mpParameters->mMinRadius,mpParameters->mRadius, mpParameters->mMinDistance, mpParameters->mDistance, mpParameters->mSeqWindow, mpParameters->mSeqShift);
 				//cout << "final " << j->name << " len=" << j->seq.size() << "idx=" << j->idx << " minH_hf " << j->minHashes.size() <<  " minh_len "<< j->minHashes[0].size() << " win=" << mpParameters->mSeqWindow << " step=" << mpParameters->mSeqShift << endl;
 			}
 
-			finishUpdate(myData,myResultChunk);
+			myResultChunk->numChunkInstances = myData->size();
+			finishUpdate(myData,myResultChunk,mpParameters->mAbundanceOutput ? &mAbundance[id] : nullptr);
+
+			// the same signatures are queried against the additional indexes; with --read_cache_size each index
+			// has its own cache, the signatures are computed by the first index that misses a sequence
+			for (unsigned i = 0; i < mExtraIndexes.size(); i++){
+				myResultChunk->extra.push_back(std::make_shared<ResultChunkT>());
+				mExtraIndexes[i]->finishUpdate(myData,myResultChunk->extra[i],mpParameters->mAbundanceOutput ? &mExtraIndexes[i]->mAbundance[id] : nullptr);
+			}
 			res_queue.push(myResultChunk);
 			if (res_queue.size()>=numWorkers*25){
 				unique_lock<mutex> lk(mut2);
@@ -191,14 +487,20 @@ void SeqClassifyManager::finisher_Results(ogzstream* fout_res){
 		ResultChunkP myResults;
 		bool succ = res_queue.try_pop(myResults);
 
-		if (!done && succ && myResults->size()>0) {
+		// chunks with parts of split sequences may have no results
+		if (!done && succ) {
 
-			for (unsigned i=0; i<myResults->size(); i++){
-				*fout_res << (*myResults)[i].output_line;
-				//mResultCounter += (*myResults)[i].numInstances;
-				sigCounter += (*myResults)[i].numInstances;
+			// one block of result lines per chunk
+			if (fout_res != nullptr)
+				fout_res->write(myResults->output.data(), myResults->output.size());
+			for (unsigned i = 0; i < myResults->extra.size(); i++){
+				if (mExtraResultsFiles[i] != nullptr)
+					mExtraResultsFiles[i]->write(myResults->extra[i]->output.data(), myResults->extra[i]->output.size());
 			}
-			mResultCounter += myResults->size()*2;
+			if (mpBinWriter != nullptr)
+				mpBinWriter->Write(myResults->bins);
+			sigCounter += myResults->numInstances;
+			mResultCounter += myResults->numChunkInstances;
 			double elap = progress_bar.getElapsed()/1000;
 			cout.setf(ios::fixed);
 			cout << "\r" <<  std::setprecision(1) << elap << " sec elapsed   Finished numSeqs=" << std::setprecision(0) << setw(10);
@@ -252,6 +554,15 @@ void SeqClassifyManager::Classify_Signatures(SeqFilesT& myFiles){
 	vector<std::thread> threads;
 	graph_queue.resize(graphWorkers);
 
+	if (mpParameters->mAbundanceOutput){
+		abundanceS empty = {vector<labelCountS>(GetHistogramSize(), labelCountS{0,0,0.0}), 0, 0};
+		mAbundance.assign(graphWorkers, empty);
+		for (unsigned i = 0; i < mExtraIndexes.size(); i++){
+			abundanceS emptyExtra = {vector<labelCountS>(mExtraIndexes[i]->GetHistogramSize(), labelCountS{0,0,0.0}), 0, 0};
+			mExtraIndexes[i]->mAbundance.assign(graphWorkers, emptyExtra);
+		}
+	}
+
 	// launch all threads
 	threads.push_back( std::thread(&SeqClassifyManager::finisher_Results,this,myFiles[0]->out_results_fh));
 	for (int i=0;i<graphWorkers;i++){
@@ -289,13 +600,20 @@ void SeqClassifyManager::finishUpdate(ChunkP& myData, unsigned& min, unsigned& m
 
 	// this is the overloaded virtual function from MinHashEncoder
 	// we assume signatureAction==INDEX always here
+	if (!mSpillIndex)
+		EstimateKeys(myData,min,max);
+
 	if (mUseSlidingWindowMinHash){
 		for (ChunkT::iterator j=myData->begin(); j!= myData->end();j++) {
 			for (uint hf=min;hf<=max;hf++){
 				unsigned last = MAXUNSIGNED;
 				for (auto i : j->minHashes[hf] ){
-					if (i != last)
-						UpdateInverseIndex(i, j->idx, hf);
+					if (i != last){
+						if (mSpillIndex)
+							SpillInverseIndex(i, j->idx, hf, min);
+						else
+							UpdateInverseIndex(i, j->idx, hf);
+					}
 					last = i;
 					if (hf==0) {
 						mSignatureUpdateCounter++;
@@ -306,7 +624,11 @@ void SeqClassifyManager::finishUpdate(ChunkP& myData, unsigned& min, unsigned& m
 	} else {
 
 		for (ChunkT::iterator j=myData->begin(); j!= myData->end();j++) {
-			UpdateInverseIndex(j->sig,j->idx,min,max);
+			if (mSpillIndex){
+				for (uint hf=min;hf<=max;hf++)
+					SpillInverseIndex(j->sig[hf], j->idx, hf, min);
+			} else
+				UpdateInverseIndex(j->sig,j->idx,min,max);
 			if (min==0){
 				mSignatureUpdateCounter++;
 			}
@@ -319,89 +641,274 @@ inline double changeNAN(double i) {if (std::isnan(i)) return 0.0; else return i;
 inline double indicator(double i) {if (i>0) return 1; else return 0;}
 
 
-void SeqClassifyManager::finishUpdate(ChunkP& myData, ResultChunkP& myResultChunk) {
+void SeqClassifyManager::finishUpdate(ChunkP& myData, ResultChunkP& myResultChunk, abundanceS* abundance) {
 
 	ChunkT::iterator j = myData->begin();
 	unsigned hist_size = GetHistogramSize();
 
+	// histograms are reused for all sequences of the chunk, only the touched labels are reset
+	SparseHistogram hist, histRC, histFR, windowHist, wins;
+	hist.Init(hist_size);
+	histRC.Init(hist_size);
+	histFR.Init(hist_size);
+	vector<unsigned> emptyBins_tmp;
+	vector<bool> screenedOut;
+
+	// sequential test of --early_stop_windows: H1 the leading label is the true label vs. H0 the runner-up is.
+	// The trials are the windows: a window is won by the label with the most hits, a window won by one of both
+	// supports the true label with probability p. The log likelihood ratio of a lead of m windows is
+	// m*log(p/(1-p)), the test stops (Wald) if it exceeds log(1/error). The hits of the sub indices of a window
+	// are strongly correlated, counting them as trials would stop far too early; overlapping windows are still
+	// correlated, i.e. the error is a lower bound.
+	const unsigned blockSize = mpParameters->mEarlyStopWindows > 0 ? mpParameters->mEarlyStopWindows : std::numeric_limits<unsigned>::max();
+	unsigned earlyStopMargin = 0;
+	if (mpParameters->mEarlyStopWindows > 0){
+		windowHist.Init(hist_size);
+		wins.Init(hist_size);
+		earlyStopMargin = ceil(log(1/mpParameters->mEarlyStopError)/log(mpParameters->mEarlyStopHitProb/(1-mpParameters->mEarlyStopHitProb)));
+	}
+
+	// --batch_query: the hits are computed for batches of at most 65536 instances, as lists of the hit labels
+	vector<vector<unsigned> > batchHits;
+	vector<vector<unsigned> > batchEmptyBins;
+	ChunkT::iterator batchBegin = myData->begin();
+	ChunkT::iterator batchEnd = myData->begin();
+	const unsigned batchSize = 65536;
+
 	while (j != myData->end()) {
-		valarray<double> hist(0.0,hist_size);
-		valarray<double> histRC(0.0,hist_size);
+		hist.Clear();
+		histRC.Clear();
+		wins.Clear();
 
 		unsigned emptyBins = 0;
 		unsigned emptyBinsRC = 0;
 
-		ChunkT::iterator k=j;
+		// all instances (strands) of the sequence
+		ChunkT::iterator end = j;
+		while (end != myData->end() && end->idx == j->idx)
+			end++;
 		unsigned matchingSigs 	= 0;
 		unsigned matchingSigsRC = 0;
 		unsigned numSigs = 0;
 		unsigned numSigsRC = 0;
+		unsigned totalSigs = 0;
+		unsigned totalSigsRC = 0;
+
+		// --read_cache_size: a sequence of a single large window is looked up by the hash of its
+		// canonical strand, the cached histograms of both strands replace hashing and the index queries
+		ReadCacheP cached;
+		uint64_t cacheKey = 0;
+		bool canonicalFwd = true;
+		const bool cacheable = mReadCache.Enabled() && end - j == 2 && !j->rc && (j+1)->rc && j->part == 0 && j->lastPart;
+		if (cacheable){
+			if (j->seqHash == 0){
+				j->seqHash = SeqHash64(j->seq);
+				(j+1)->seqHash = SeqHash64((j+1)->seq);
+			}
+			uint64_t hashFwd = j->seqHash;
+			uint64_t hashRC = (j+1)->seqHash;
+			canonicalFwd = hashFwd <= hashRC;
+			cacheKey = canonicalFwd ? hashFwd : hashRC;
+			const string& canonicalSeq = canonicalFwd ? j->seq : (j+1)->seq;
+			mReadCache.Get(cacheKey, cached, [&](const readCacheS& c){ return c.seq == canonicalSeq; });
+		}
 
-		do {
-			valarray<double> hist_tmp;
-			vector<unsigned> emptyBins_tmp;
-			// compute hist for all sliding windows at once
-			ComputeHistogram(k->minHashes,hist_tmp,emptyBins_tmp);
-
-			switch (k->rc){
-			case true:
-				histRC += hist_tmp;
-				for (uint i = 0; i < emptyBins_tmp.size(); ++i){
-					if ( emptyBins_tmp[i] < mpParameters->mNumHashFunctions) matchingSigsRC++;
-					emptyBinsRC += emptyBins_tmp[i];
+		if (cached){
+			const strandCacheS& fwd = cached->strands[canonicalFwd ? 0 : 1];
+			const strandCacheS& rc = cached->strands[canonicalFwd ? 1 : 0];
+			for (unsigned i = 0; i < fwd.hist.size(); i++)
+				hist.Add(fwd.hist[i].first, fwd.hist[i].second);
+			for (unsigned i = 0; i < rc.hist.size(); i++)
+				histRC.Add(rc.hist[i].first, rc.hist[i].second);
+			emptyBins = fwd.emptyBins;
+			emptyBinsRC = rc.emptyBins;
+			matchingSigs = fwd.matchingSigs;
+			matchingSigsRC = rc.matchingSigs;
+			numSigs = fwd.numSigs;
+			numSigsRC = rc.numSigs;
+			totalSigs = fwd.totalSigs;
+			totalSigsRC = rc.totalSigs;
+		} else {
+			// with the cache the signatures are only computed for sequences that are not cached; they are
+			// kept in the chunk, i.e. computed at most once for the misses of all indexes
+			for (ChunkT::iterator k = j; k != end; k++) {
+				if (k->minHashes.empty())
+					sliding_window_minhash(k->minHashes,k->seq,mpParameters->mMinRadius,mpParameters->mRadius, mpParameters->mMinDistance, mpParameters->mDistance, mpParameters->mSeqWindow, mpParameters->mSeqShift);
+			}
+			screenedOut.assign(end - j, false);
+
+			// --early_stop_windows: the windows of all instances are evaluated block by block until the
+			// leading label is significantly better than the runner-up, otherwise all windows form one block
+			for (unsigned sigBegin = 0; ; sigBegin += blockSize){
+				bool moreSigs = false;
+				for (ChunkT::iterator k = j; k != end; k++) {
+					unsigned instSigs = k->minHashes[0].size();
+					if (sigBegin > 0 && (sigBegin >= instSigs || screenedOut[k - j]))
+						continue;
+					unsigned sigEnd = instSigs - sigBegin > blockSize ? sigBegin + blockSize : instSigs;
+					if (sigBegin == 0)
+						(k->rc ? totalSigsRC : totalSigs) += instSigs;
+
+					// hits of the sliding windows are added to the histogram of the strand
+					SparseHistogram& hist_tmp = k->rc ? histRC : hist;
+					if (mpParameters->mBatchQuery){
+						if (k == batchEnd){
+							batchBegin = k;
+							batchEnd = k + std::min((long)batchSize, (long)(myData->end() - k));
+							ComputeHistogramBatch(batchBegin, batchEnd, batchHits, batchEmptyBins);
+						}
+						const vector<unsigned>& instanceHits = batchHits[k - batchBegin];
+						for (unsigned i = 0; i < instanceHits.size(); i++)
+							hist_tmp.Add(instanceHits[i], 1);
+						emptyBins_tmp.swap(batchEmptyBins[k - batchBegin]);
+					} else if (sigBegin == 0 && mpParameters->mScreenHashFunctions > 0 && !ScreenInstance(k->minHashes, mpParameters->mScreenHashFunctions, mpParameters->mScreenMinHits)){
+						// screened out, all windows are reported without any hit
+						emptyBins_tmp.assign(instSigs, mpParameters->mNumHashFunctions);
+						screenedOut[k - j] = true;
+						mScreenedInstances++;
+					} else {
+						if (mpParameters->mEarlyStopWindows > 0)
+							ComputeHistogramWindows(k->minHashes,hist_tmp,emptyBins_tmp,sigBegin,sigEnd,windowHist,wins);
+						else
+							ComputeHistogram(k->minHashes,hist_tmp,emptyBins_tmp,sigBegin,sigEnd);
+						if (sigBegin == 0 && mpParameters->mScreenHashFunctions > 0){
+							mScreenedInstances++;
+							mScreenCandidates++;
+						}
+						if (sigEnd < instSigs)
+							moreSigs = true;
+					}
+
+					switch (k->rc){
+					case true:
+						for (uint i = 0; i < emptyBins_tmp.size(); ++i){
+							if ( emptyBins_tmp[i] < mpParameters->mNumHashFunctions) matchingSigsRC++;
+							emptyBinsRC += emptyBins_tmp[i];
+						}
+						numSigsRC += emptyBins_tmp.size();
+						break;
+					case false:
+						for (uint i = 0; i< emptyBins_tmp.size(); ++i){
+							if ( emptyBins_tmp[i] < mpParameters->mNumHashFunctions) matchingSigs++;
+							emptyBins += emptyBins_tmp[i];
+						}
+						numSigs += emptyBins_tmp.size();
+						break;
+					}
 				}
-				numSigsRC += emptyBins_tmp.size();
-				break;
-			case false:
-				hist += hist_tmp;
-				for (uint i = 0; i< emptyBins_tmp.size(); ++i){
-					if ( emptyBins_tmp[i] < mpParameters->mNumHashFunctions) matchingSigs++;
-					emptyBins += emptyBins_tmp[i];
+				if (!moreSigs)
+					break;
+
+				// sequential probability ratio test over the windows of both strands
+				unsigned first, second;
+				wins.MaxTwo(first, second);
+				if (first - second >= earlyStopMargin){
+					mEarlyStopped++;
+					break;
 				}
-				numSigs += emptyBins_tmp.size();
-				break;
 			}
-			k++;
-		} while (k != myData->end() && k->idx == j->idx);
 
-		ResultT myResult;
-		unsigned max = hist.max();
-		unsigned maxRC = histRC.max();
+			if (cacheable){
+				std::shared_ptr<readCacheS> entry = std::make_shared<readCacheS>();
+				entry->seq = canonicalFwd ? j->seq : (j+1)->seq;
+				strandCacheS& fwd = entry->strands[canonicalFwd ? 0 : 1];
+				strandCacheS& rc = entry->strands[canonicalFwd ? 1 : 0];
+				for (unsigned i = 0; i < hist.Touched().size(); i++)
+					fwd.hist.push_back(make_pair(hist.Touched()[i], hist[hist.Touched()[i]]));
+				for (unsigned i = 0; i < histRC.Touched().size(); i++)
+					rc.hist.push_back(make_pair(histRC.Touched()[i], histRC[histRC.Touched()[i]]));
+				fwd.emptyBins = emptyBins;
+				rc.emptyBins = emptyBinsRC;
+				fwd.matchingSigs = matchingSigs;
+				rc.matchingSigs = matchingSigsRC;
+				fwd.numSigs = numSigs;
+				rc.numSigs = numSigsRC;
+				fwd.totalSigs = totalSigs;
+				rc.totalSigs = totalSigsRC;
+				mReadCache.Put(cacheKey, entry);
+			}
+		}
+
+		// a part of a split sequence is added to the sums of the sequence, which is reported with its last part
+		if (j->part > 0 || !j->lastPart){
+			std::lock_guard<std::mutex> lk(mut_split);
+			std::unordered_map<unsigned, splitSeqS>::iterator it = mSplitSeqs.find(j->idx);
+			if (it == mSplitSeqs.end()){
+				it = mSplitSeqs.insert(make_pair(j->idx, splitSeqS())).first;
+				it->second.hist.Init(hist_size);
+				it->second.histRC.Init(hist_size);
+			}
+			splitSeqS& seq = it->second;
+			seq.hist.Add(hist);
+			seq.histRC.Add(histRC);
+			seq.emptyBins += emptyBins;
+			seq.emptyBinsRC += emptyBinsRC;
+			seq.matchingSigs += matchingSigs;
+			seq.matchingSigsRC += matchingSigsRC;
+			seq.numSigs += numSigs;
+			seq.numSigsRC += numSigsRC;
+			seq.totalSigs += totalSigs;
+			seq.totalSigsRC += totalSigsRC;
+			seq.parts++;
+			if (j->lastPart)
+				seq.numParts = j->part + 1;
+			if (seq.numParts == 0 || seq.parts < seq.numParts){
+				j = end;
+				continue;
+			}
+
+			hist.Clear();
+			hist.Add(seq.hist);
+			histRC.Clear();
+			histRC.Add(seq.histRC);
+			emptyBins = seq.emptyBins;
+			emptyBinsRC = seq.emptyBinsRC;
+			matchingSigs = seq.matchingSigs;
+			matchingSigsRC = seq.matchingSigsRC;
+			numSigs = seq.numSigs;
+			numSigsRC = seq.numSigsRC;
+			totalSigs = seq.totalSigs;
+			totalSigsRC = seq.totalSigsRC;
+			mSplitSeqs.erase(it);
+		}
+
+		if (mpParameters->mEarlyStopWindows > 0){
+			mEvaluatedWindows += numSigs + numSigsRC;
+			mTotalWindows += totalSigs + totalSigsRC;
+		}
+
+		unsigned max = hist.Max();
+		unsigned maxRC = histRC.Max();
+
+		// both strands
+		if (j->seqFile->strandType == FR || j->seqFile->strandType == FR_sep || mpParameters->mVerbose){
+			histFR.Clear();
+			histFR.Add(hist);
+			histFR.Add(histRC);
+		}
 
 		switch (j->seqFile->strandType){
 		case FWD:
-			myResult.numInstances = numSigs;
-			getResultString(myResult.output_line,hist,emptyBins,matchingSigs,numSigs,j->name,FWD);
-			myResultChunk->push_back(myResult);
+			WriteResult(*myResultChunk,hist,emptyBins,matchingSigs,numSigs,totalSigs,j->name,FWD);
 			break;
 		case REV:
-			myResult.numInstances = numSigsRC;
-			getResultString(myResult.output_line,histRC,emptyBinsRC,matchingSigsRC,numSigsRC,j->name,REV);
-			myResultChunk->push_back(myResult);
+			WriteResult(*myResultChunk,histRC,emptyBinsRC,matchingSigsRC,numSigsRC,totalSigsRC,j->name,REV);
 			break;
 		case FR:
 			switch (mpParameters->mOutputTypeCode){
 			case ALL:
 			case MAX:
-				myResult.numInstances = numSigs+numSigsRC;
-				getResultString(myResult.output_line,hist+histRC,emptyBins+emptyBinsRC,matchingSigs+matchingSigsRC,numSigs+numSigsRC,j->name,FR);
-				myResultChunk->push_back(myResult);
+				WriteResult(*myResultChunk,histFR,emptyBins+emptyBinsRC,matchingSigs+matchingSigsRC,numSigs+numSigsRC,totalSigs+totalSigsRC,j->name,FR);
 				break;
 			case ALL_STRAND:
 			case MAX_STRAND:
 
 				if (max > maxRC){
-					myResult.numInstances = numSigs;
-					getResultString(myResult.output_line,hist,emptyBins,matchingSigs,numSigs,j->name,FWD);
-					myResultChunk->push_back(myResult);
+					WriteResult(*myResultChunk,hist,emptyBins,matchingSigs,numSigs,totalSigs,j->name,FWD);
 				} else if (maxRC>max){
-					myResult.numInstances = numSigsRC;
-					getResultString(myResult.output_line,histRC,emptyBinsRC,matchingSigsRC,numSigsRC,j->name,REV);
-					myResultChunk->push_back(myResult);
+					WriteResult(*myResultChunk,histRC,emptyBinsRC,matchingSigsRC,numSigsRC,totalSigsRC,j->name,REV);
 				} else {
-					myResult.numInstances = numSigs+numSigsRC;
-					getResultString(myResult.output_line,hist+histRC,emptyBins+emptyBinsRC,matchingSigs+matchingSigsRC,numSigs+numSigsRC,j->name,FR);
-					myResultChunk->push_back(myResult);
+					WriteResult(*myResultChunk,histFR,emptyBins+emptyBinsRC,matchingSigs+matchingSigsRC,numSigs+numSigsRC,totalSigs+totalSigsRC,j->name,FR);
 				}
 				break;
 			default:
@@ -409,44 +916,58 @@ void SeqClassifyManager::finishUpdate(ChunkP& myData, ResultChunkP& myResultChun
 			}
 			break;
 		case FR_sep:
-				myResult.numInstances = numSigs;
-				getResultString(myResult.output_line,hist,emptyBins,matchingSigs,numSigs,j->name,FWD);
-				myResultChunk->push_back(myResult);
-				myResult.numInstances = numSigsRC;
-				getResultString(myResult.output_line,histRC,emptyBinsRC,matchingSigsRC,numSigsRC,j->name,REV);
-				myResultChunk->push_back(myResult);
+				WriteResult(*myResultChunk,hist,emptyBins,matchingSigs,numSigs,totalSigs,j->name,FWD);
+				WriteResult(*myResultChunk,histRC,emptyBinsRC,matchingSigsRC,numSigsRC,totalSigsRC,j->name,REV);
 				break;
 		default:
 			break;
 		}
 
-		j = k;
+		// the read counts and the bin for the label(s) of its reported strand
+		if (abundance != nullptr || mpBinWriter != nullptr){
+			SparseHistogram* reportedHist = &histFR;
+			unsigned reportedSigs = numSigs+numSigsRC;
+			switch (j->seqFile->strandType){
+			case FWD:
+				reportedHist = &hist;
+				reportedSigs = numSigs;
+				break;
+			case REV:
+				reportedHist = &histRC;
+				reportedSigs = numSigsRC;
+				break;
+			default:
+				if ((mpParameters->mOutputTypeCode == ALL_STRAND || mpParameters->mOutputTypeCode == MAX_STRAND) && max != maxRC){
+					reportedHist = (max > maxRC) ? &hist : &histRC;
+					reportedSigs = (max > maxRC) ? numSigs : numSigsRC;
+				}
+				break;
+			}
+			if (abundance != nullptr)
+				AddAbundance(*reportedHist, reportedSigs, *abundance);
+			if (mpBinWriter != nullptr)
+				AddBinRecord(*myResultChunk, *reportedHist, reportedSigs, *j->record);
+		}
+
+		j = end;
 		++mNumSequences;
 
 		// meta analysis, only for screen output summary
 		if (mpParameters->mVerbose){
 
-			hist += histRC;
-			unsigned sum = hist.sum();
-			unsigned max = hist.max();
+			unsigned sum = histFR.Sum();
+			unsigned max = histFR.Max();
 
 			if (sum>0)
 				mClassifiedInstances++;
 
-			valarray<double> hist_t = hist;
-			hist_t /= ( (numSigs+numSigsRC)*mpParameters->mNumHashFunctions);
-
-			hist_t /= sum;
-			hist_t = hist.apply(changeNAN);
-
-			for (unsigned i = 0; i<hist_size; i++){
-				if (hist[i] >= max  && max != 0) {hist[i] = 1;} else { hist[i]=0;};
-			}
-
 			{
 				std::lock_guard<std::mutex> lk(mut_meta);
-				metaHist += hist_t;
-				metaHistNum += hist;
+				const vector<unsigned>& labels = histFR.Touched();
+				for (unsigned i = 0; i<labels.size(); i++){
+					metaHist[labels[i]] += histFR[labels[i]];
+					if (histFR[labels[i]] >= max) metaHistNum[labels[i]] += 1;
+				}
 			}
 		}
 	}
@@ -562,83 +1083,123 @@ void SeqClassifyManager::finishUpdate(ChunkP& myData, ResultChunkP& myResultChun
 }*/
 
 
-void SeqClassifyManager::getResultString(string& resT,histogramT hist,unsigned emptyBins, unsigned matchingSigs, unsigned numSigs, string& name, strandTypeT strand){
+void SeqClassifyManager::WriteResult(ResultChunkT& resultChunk,SparseHistogram& hist,unsigned emptyBins, unsigned matchingSigs, unsigned numSigs, unsigned totalSigs, string& name, strandTypeT strand){
+
+	resultChunk.numResults++;
+	resultChunk.numInstances += numSigs;
 
-	stringstream res;
+	// --no_read_output: results are only counted
+	if (mpParameters->mNoReadOutput && !resultChunk.keepReads)
+		return;
 
-	uint sum = hist.sum();
-	uint max = hist.max();
+	uint sum = hist.Sum();
+	uint max = hist.Max();
 
+	// labels are reported in increasing order, labels below --pure_approximate_sim are not reported
+	hist.SortTouched();
+	const vector<unsigned>& labels = hist.Touched();
+	vector<bool> reported(labels.size(), true);
 	if (mpParameters->mPureApproximateSim != 0) {
-		for (uint i = 0; i<hist.size(); i++){
-			if (hist[i] / (numSigs*mpParameters->mNumHashFunctions) < mpParameters->mPureApproximateSim ) {
-				hist[i] = 0.0;
+		for (uint i = 0; i<labels.size(); i++){
+			if ((double)hist[labels[i]] / (numSigs*mpParameters->mNumHashFunctions) < mpParameters->mPureApproximateSim ) {
+				reported[i] = false;
 			};
 		}
 	}
+	// MAX output types report the best labels only
+	if (mpParameters->mOutputTypeCode == MAX || mpParameters->mOutputTypeCode == MAX_STRAND) {
+		for (uint i = 0; i<labels.size(); i++){
+			if (hist[labels[i]] != max)
+				reported[i] = false;
+		}
+	}
 
-	string str;
+	char str;
 	switch (strand) {
 	case FWD:
-		str="+";
+		str='+';
 		break;
 	case REV:
-		str="-";
-		break;
-	case FR:
-		str=".";
+		str='-';
 		break;
 	default:
+		str='.';
 		break;
 	}
 
-	res << name << "\t" << str << "\t"<< numSigs << "\t" << matchingSigs <<  "\t" << (numSigs*mpParameters->mNumHashFunctions)-emptyBins << "\t" << sum << "\t" << max << "\t";
-
-	string maxIndices;
-	string indices;
-	string values;
-
-	switch (mpParameters->mOutputTypeCode){
-	case ALL_STRAND:
-	case ALL:
-		for (unsigned i=0; i<hist.size();i++){
-			if (hist[i]>0.0) {
-				char buf[30];
-				sprintf( buf,"%.0f",hist[i] );
-				values += std::string(buf) +",";
-				//values += std::to_string((int)hist[i])+",";
-				//sprintf( buf,"%i",i+1 );
-				indices += std::to_string(i+1)+ ",";
-				//indices += std::string(buf) +",";
-				if (hist[i]==max && max!=0){
-					//maxIndices += std::string(buf) +",";
-					maxIndices+=std::to_string(i+1)+ ","; // << i+1 << ",";
+	// same content as the result line
+	if (resultChunk.keepReads) {
+		resultChunk.reads.push_back(readResultS());
+		readResultS& res = resultChunk.reads.back();
+		res.name = name;
+		res.strand = str;
+		res.numSigs = numSigs;
+		res.matchingSigs = matchingSigs;
+		res.hits = (numSigs*mpParameters->mNumHashFunctions)-emptyBins;
+		res.sum = sum;
+		res.max = max;
+		res.totalSigs = totalSigs;
+		if (max!=0) {
+			for (unsigned i=0; i<labels.size();i++){
+				if (reported[i]) {
+					res.labels.push_back(make_pair(labels[i]+1, hist[labels[i]]));
+					if (hist[labels[i]]==max)
+						res.bestLabels.push_back(labels[i]+1);
 				}
 			}
 		}
-		break;
-	case MAX:
-	case MAX_STRAND:
-		for (unsigned i=0; i<hist.size();i++){
-			if (hist[i]==max && max!=0){
-				char buf[30];
-				sprintf( buf,"%.0f",hist[i] );
-				values += std::string(buf) +",";
-				indices += std::to_string(i+1)+ ",";
-				maxIndices+=std::to_string(i+1)+ ",";
+		return;
+	}
+
+	// the line is appended to the buffer of the chunk
+	string& out = resultChunk.output;
+	out += name;
+	out += '\t';
+	out += str;
+	out += '\t';
+	AppendUnsigned(out, numSigs);
+	out += '\t';
+	AppendUnsigned(out, matchingSigs);
+	out += '\t';
+	AppendUnsigned(out, (numSigs*mpParameters->mNumHashFunctions)-emptyBins);
+	out += '\t';
+	AppendUnsigned(out, sum);
+	out += '\t';
+	AppendUnsigned(out, max);
+	out += '\t';
+
+	if (max!=0) {
+		for (unsigned i=0; i<labels.size();i++){
+			if (reported[i]) {
+				AppendUnsigned(out, labels[i]+1);
+				out += ',';
+			}
+		}
+		out += '\t';
+		for (unsigned i=0; i<labels.size();i++){
+			if (reported[i]) {
+				AppendUnsigned(out, hist[labels[i]]);
+				out += ',';
+			}
+		}
+		out += '\t';
+		for (unsigned i=0; i<labels.size();i++){
+			if (reported[i] && hist[labels[i]]==max) {
+				AppendUnsigned(out, labels[i]+1);
+				out += ',';
 			}
 		}
-		break;
-	default:
-		break;
 	}
 
-	if (max!=0) {
-		res << indices << "\t" <<values << "\t" << maxIndices;
+	// all windows of the sequence, SIGS are the evaluated windows
+	if (mpParameters->mEarlyStopWindows > 0) {
+		if (max == 0)
+			out += "\t\t";
+		out += '\t';
+		AppendUnsigned(out, totalSigs);
 	}
 
-	res << "\n";
-	resT = res.str();
+	out += '\n';
 }
 
 void SeqClassifyManager::ClassifySeqs(){
@@ -655,6 +1216,10 @@ void SeqClassifyManager::ClassifySeqs(){
 	mySet->checkUniqueSeqNames = false;
 	mySet->signatureAction	   = CLASSIFY;
 	mySet->strandType          = FR;
+	// the windows of a sequence are needed together for --early_stop_windows and --bin_output
+	mySet->splitSeqs           = mpParameters->mEarlyStopWindows == 0 && !mpParameters->mBinOutput;
+	// every input record is written to one bin as it is in the input file
+	mySet->keepRecords         = mpParameters->mBinOutput;
 
 	// write results file header and get results file handle
 	string resultsName = mpParameters->mInputDataFileName;
@@ -662,18 +1227,41 @@ void SeqClassifyManager::ClassifySeqs(){
 	if (std::string::npos != pos)
 		resultsName = mpParameters->mInputDataFileName.substr(pos+1);
 
-	mySet->out_results_fh = PrepareResultsFile(mpParameters->mDirectoryPath+resultsName+".classified.tab.gz");
+	// with several indexes the results of each index are named after its BED file
+	vector<string> indexResultsNames(1, resultsName);
+	if (mExtraIndexes.size() > 0){
+		indexResultsNames.clear();
+		for (unsigned i = 0; i < mpParameters->mIndexBedFiles.size(); i++){
+			string indexName = mpParameters->mIndexBedFiles[i];
+			const unsigned posIndex = indexName.find_last_of("/");
+			if (std::string::npos != posIndex)
+				indexName = indexName.substr(posIndex+1);
+			indexResultsNames.push_back(resultsName+"."+indexName);
+		}
+	}
 
-	metaHist.resize(GetHistogramSize());
-	metaHist *= 0;
+	mySet->out_results_fh = nullptr;
+	mExtraResultsFiles.assign(mExtraIndexes.size(), nullptr);
+	if (!mpParameters->mNoReadOutput){
+		mySet->out_results_fh = PrepareResultsFile(mpParameters->mDirectoryPath+indexResultsNames[0]+".classified.tab.gz");
+		for (unsigned i = 0; i < mExtraIndexes.size(); i++)
+			mExtraResultsFiles[i] = mExtraIndexes[i]->PrepareResultsFile(mpParameters->mDirectoryPath+indexResultsNames[i+1]+".classified.tab.gz");
+	}
 
-	metaHistNum.resize(GetHistogramSize());
-	metaHistNum *= 0;
+	ResetCounters();
+	for (unsigned i = 0; i < mExtraIndexes.size(); i++)
+		mExtraIndexes[i]->ResetCounters();
 
-	mClassifiedInstances = 0;
-	mNumSequences = 0;
+	if (mpParameters->mReadCacheSize > 0){
+		mReadCache.Init(mpParameters->mReadCacheSize);
+		for (unsigned i = 0; i < mExtraIndexes.size(); i++)
+			mExtraIndexes[i]->mReadCache.Init(mpParameters->mReadCacheSize);
+	}
 
-	wobbleDist = 1;
+	if (mpParameters->mBinOutput){
+		mpBinWriter = new SeqBinWriter(mpParameters);
+		mpBinWriter->Init(resultsName, mFeature2IndexValue, GetHistogramSize());
+	}
 
 	SeqFilesT myList;
 	myList.push_back(mySet);
@@ -681,7 +1269,46 @@ void SeqClassifyManager::ClassifySeqs(){
 	//do the real work
 	Classify_Signatures(myList);
 
-	mySet->out_results_fh->close();
+	if (mySet->out_results_fh != nullptr){
+		mySet->out_results_fh->close();
+	}
+	for (unsigned i = 0; i < mExtraResultsFiles.size(); i++){
+		if (mExtraResultsFiles[i] != nullptr){
+			mExtraResultsFiles[i]->close();
+			delete mExtraResultsFiles[i];
+		}
+	}
+
+	if (mpBinWriter != nullptr){
+		mpBinWriter->Close();
+		delete mpBinWriter;
+		mpBinWriter = nullptr;
+	}
+
+	if (mpParameters->mAbundanceOutput){
+		WriteAbundance(indexResultsNames[0]+".abundance.tab");
+		for (unsigned i = 0; i < mExtraIndexes.size(); i++)
+			mExtraIndexes[i]->WriteAbundance(indexResultsNames[i+1]+".abundance.tab");
+	}
+
+	if (mpParameters->mScreenHashFunctions > 0){
+		ostringstream stats;
+		stats << endl << "Screen with " << mpParameters->mScreenHashFunctions << " hash functions: " << mScreenCandidates << " of " << mScreenedInstances;
+		stats << " instances are candidates (" << setprecision(3) << 100.0*mScreenCandidates/std::max(1U,(unsigned)mScreenedInstances) << "%)" << endl;
+		cout << stats.str();
+	}
+	if (mReadCache.Enabled()){
+		ostringstream stats;
+		stats << endl << "Read cache: " << mReadCache.Hits() << " hits, " << mReadCache.Misses() << " misses (";
+		stats << setprecision(1) << fixed << 100.0*mReadCache.Hits()/std::max((uint64_t)1,mReadCache.Hits()+mReadCache.Misses()) << "% hits)" << endl;
+		cout << stats.str();
+	}
+	if (mpParameters->mEarlyStopWindows > 0){
+		ostringstream stats;
+		stats << endl << "Early stop: " << mEarlyStopped << " of " << mNumSequences << " sequences stopped, " << mEvaluatedWindows << " of " << mTotalWindows;
+		stats << " windows evaluated (" << setprecision(3) << 100.0*mEvaluatedWindows/std::max((uint64_t)1,(uint64_t)mTotalWindows) << "%)" << endl;
+		cout << stats.str();
+	}
 
 	/////////////////////////////////////////////////////////////////////////////
 	// classification finished
@@ -720,6 +1347,21 @@ void SeqClassifyManager::ClassifySeqs(){
 				indexHist[itBin->second[0]-1] += 1;
 			}
 		}
+		for (typename HistogramIndex::setIndexTy::const_iterator it = mSetIndex.begin(); it!= mSetIndex.end(); it++){
+			for (typename HistogramIndex::setIndexSingleTy::const_iterator itBin = it->begin(); itBin!=it->end(); itBin++){
+				indexHist[GetLabelSetSize(itBin->second)-1] += 1;
+			}
+		}
+		for (unsigned hf = 0; hf < mInlineTables.size(); hf++){
+			for (uint64_t i = 0; i < mInlineTables[hf].GetNumSlots(); i++){
+				if (mInlineTables[hf].GetSlotSize(i) > 0)
+					indexHist[mInlineTables[hf].GetSlotSize(i)-1] += 1;
+			}
+		}
+		for (unsigned hf = 0; hf < mKeyTables.size(); hf++){
+			for (auto setId : mKeyTables[hf].GetValues())
+				indexHist[GetLabelSetSize(setId)-1] += 1;
+		}
 
 
 		const char * indexBinSizePath;
@@ -742,6 +1384,167 @@ void SeqClassifyManager::ClassifySeqs(){
 	}
 }
 
+void SeqClassifyManager::ResetCounters(){
+
+	metaHist.resize(GetHistogramSize());
+	metaHist *= 0;
+
+	metaHistNum.resize(GetHistogramSize());
+	metaHistNum *= 0;
+
+	mClassifiedInstances = 0;
+	mNumSequences = 0;
+	mScreenedInstances = 0;
+	mScreenCandidates = 0;
+	mEarlyStopped = 0;
+	mEvaluatedWindows = 0;
+	mTotalWindows = 0;
+
+	wobbleDist = 1;
+}
+
+void SeqClassifyManager::ComputeHistogramWindows(const vector<vector<unsigned> >& aSigArray, SparseHistogram& hist, vector<unsigned>& emptyBins, unsigned sigBegin, unsigned sigEnd, SparseHistogram& windowHist, SparseHistogram& wins){
+
+	sigEnd = std::min(sigEnd, (unsigned)aSigArray[0].size());
+	emptyBins.clear();
+	vector<unsigned> windowEmptyBins;
+	for (unsigned sig = sigBegin; sig < sigEnd; sig++){
+		windowHist.Clear();
+		ComputeHistogram(aSigArray, windowHist, windowEmptyBins, sig, sig+1);
+		hist.Add(windowHist);
+		emptyBins.push_back(windowEmptyBins[0]);
+
+		// a window with several labels of the most hits is no trial
+		unsigned best = 0, bestCount = 0;
+		bool tie = false;
+		const vector<unsigned>& labels = windowHist.Touched();
+		for (unsigned i = 0; i < labels.size(); i++){
+			if (windowHist[labels[i]] > bestCount){
+				best = labels[i];
+				bestCount = windowHist[labels[i]];
+				tie = false;
+			} else if (windowHist[labels[i]] == bestCount){
+				tie = true;
+			}
+		}
+		if (bestCount > 0 && !tie)
+			wins.Add(best, 1);
+	}
+}
+
+void SeqClassifyManager::AddAbundance(SparseHistogram& hist, unsigned numSigs, abundanceS& abundance){
+
+	// best labels as in the results file, i.e. labels below --pure_approximate_sim are not counted
+	unsigned max = hist.Max();
+	unsigned numBest = 0;
+	const vector<unsigned>& labels = hist.Touched();
+	for (unsigned i = 0; i < labels.size(); i++){
+		if (max != 0 && hist[labels[i]] == max && BestLabel(hist[labels[i]], numSigs))
+			numBest++;
+	}
+
+	if (numBest == 0){
+		abundance.unclassified++;
+		return;
+	}
+	abundance.classified++;
+	for (unsigned i = 0; i < labels.size(); i++){
+		if (max == 0 || hist[labels[i]] != max || !BestLabel(hist[labels[i]], numSigs))
+			continue;
+		labelCountS& count = abundance.labels[labels[i]];
+		if (numBest == 1)
+			count.unique++;
+		else
+			count.ambiguous++;
+		count.assigned += 1.0/numBest;
+	}
+}
+
+void SeqClassifyManager::AddBinRecord(ResultChunkT& resultChunk, SparseHistogram& hist, unsigned numSigs, const string& aRecord){
+
+	// category of the best labels as in the results file, best labels of different categories are ambiguous
+	unsigned max = hist.Max();
+	unsigned category = SeqBinWriter::UNCLASSIFIED;
+	bool found = false;
+	const vector<unsigned>& labels = hist.Touched();
+	for (unsigned i = 0; i < labels.size(); i++){
+		if (max == 0 || hist[labels[i]] != max || !BestLabel(hist[labels[i]], numSigs))
+			continue;
+		unsigned labelCategory = mpBinWriter->GetLabelCategory(labels[i]+1);
+		if (found && labelCategory != category){
+			category = SeqBinWriter::AMBIGUOUS;
+			break;
+		}
+		category = labelCategory;
+		found = true;
+	}
+
+	if (resultChunk.bins.size() == 0)
+		resultChunk.bins.resize(mpBinWriter->GetNumCategories());
+	SeqBinWriter::BinBufferT& bin = resultChunk.bins[category];
+	bin.numSeqs++;
+	bin.records += aRecord;
+}
+
+void SeqClassifyManager::SkippedSequences(SeqFileP& myData, vector<std::shared_ptr<const string> >& aRecords){
+
+	if (mpBinWriter == nullptr)
+		return;
+
+	// sequences without a window have no results and are binned as unclassified
+	vector<SeqBinWriter::BinBufferT> bins(mpBinWriter->GetNumCategories());
+	for (unsigned i = 0; i < aRecords.size(); i++)
+		bins[SeqBinWriter::UNCLASSIFIED].records += *aRecords[i];
+	bins[SeqBinWriter::UNCLASSIFIED].numSeqs = aRecords.size();
+	mpBinWriter->Write(bins);
+}
+
+void SeqClassifyManager::WriteAbundance(string filename){
+
+	// merge the partial sums of all worker threads
+	abundanceS total = {vector<labelCountS>(GetHistogramSize(), labelCountS{0,0,0.0}), 0, 0};
+	for (unsigned t = 0; t < mAbundance.size(); t++){
+		for (unsigned i = 0; i < total.labels.size(); i++){
+			total.labels[i].unique += mAbundance[t].labels[i].unique;
+			total.labels[i].ambiguous += mAbundance[t].labels[i].ambiguous;
+			total.labels[i].assigned += mAbundance[t].labels[i].assigned;
+		}
+		total.classified += mAbundance[t].classified;
+		total.unclassified += mAbundance[t].unclassified;
+	}
+	vector<abundanceS>().swap(mAbundance);
+
+	vector<pair<double,uint> > sortedLabels;
+	for (unsigned i = 0; i < total.labels.size(); i++){
+		if (total.labels[i].assigned > 0)
+			sortedLabels.push_back(make_pair(-total.labels[i].assigned, i));
+	}
+	sort(sortedLabels.begin(), sortedLabels.end());
+
+	map<uint,string> idx2Feature;
+	for (std::map<string,uint>::iterator it = mFeature2IndexValue.begin(); it != mFeature2IndexValue.end();++it)
+		idx2Feature[it->second] = it->first;
+
+	OutputManager om(filename.c_str(), mpParameters->mDirectoryPath);
+	om.mOut << "#SEQUENCES\t" << total.classified + total.unclassified << endl;
+	om.mOut << "#CLASSIFIED\t" << total.classified << endl;
+	om.mOut << "#UNCLASSIFIED\t" << total.unclassified << endl;
+	om.mOut << "#IDX\tFEATURE\tUNIQUE\tAMBIGUOUS\tASSIGNED\tABUNDANCE\tDESC" << endl;
+	for (unsigned j = 0; j < sortedLabels.size(); j++){
+		unsigned i = sortedLabels[j].second;
+		om.mOut << i+1 << "\t" << idx2Feature[i+1] << "\t" << total.labels[i].unique << "\t" << total.labels[i].ambiguous << "\t";
+		om.mOut << total.labels[i].assigned << "\t" << total.labels[i].assigned/total.classified << "\t";
+		multimap<uint,Data::BEDentryP>::iterator it = mIndexValue2Feature.find(i+1);
+		if (it != mIndexValue2Feature.end() && it->second->COLS.size()>=2)
+			om.mOut << it->second->COLS[1];
+		om.mOut << endl;
+	}
+	om.mOut.close();
+
+	cout << endl << "Abundance of " << sortedLabels.size() << " labels written to " << om.GetFullPathFileName() << " (" << total.classified << " of ";
+	cout << total.classified + total.unclassified << " sequences classified)" << endl;
+}
+
 ogzstream* SeqClassifyManager::PrepareResultsFile(string filename){
 
 	ogzstream* fout = new ogzstream(filename.c_str(),std::ios::out);
@@ -764,6 +1567,11 @@ ogzstream* SeqClassifyManager::PrepareResultsFile(string filename){
 	*fout << "#PARAM\tSEQWINDOW\t" << mpParameters->mSeqWindow<< endl;
 	*fout << "#PARAM\tINDEXSEQSHIFT\t" << mpParameters->mIndexSeqShift << endl;
 	*fout << "#PARAM\tHISTOGRAMSIZE\t" << GetHistogramSize() << endl;
+	if (mIndexFlags & INDEX_FLAG_PRUNED){
+		*fout << "#PARAM\tPRUNED\t1" << endl;
+		*fout << "#PARAM\tPRUNEMAXBINSIZE\t" << mpParameters->mPruneMaxBinSize << endl;
+		*fout << "#PARAM\tPRUNEMAXENTROPY\t" << mpParameters->mPruneMaxEntropy << endl;
+	}
 	*fout << "##" << endl;
 	*fout << "##CLASSIFY PARAMETERS" << endl;
 	*fout << "##" << endl;
@@ -771,6 +1579,33 @@ ogzstream* SeqClassifyManager::PrepareResultsFile(string filename){
 	*fout << "#PARAM\tSEQSHIFT\t" <<mpParameters->mSeqShift << endl;
 	*fout << "#PARAM\tSEQCLIP\t" <<mpParameters->mSeqClip << endl;
 	*fout << "#PARAM\tAPPROXSIM\t" <<mpParameters->mPureApproximateSim << endl;
+	if (mpParameters->mScreenHashFunctions > 0){
+		// expected fraction of windows that pass the screen: each of the n screen lookups of a window
+		// of similarity APPROXSIM hits with probability APPROXSIM, P(hits >= SCREENMINHITS); the screen
+		// is applied per window, i.e. a sequence is a candidate if one of its windows passes
+		unsigned n = std::min(mpParameters->mScreenHashFunctions, mpParameters->mNumHashFunctions);
+		double p = mpParameters->mPureApproximateSim;
+		double expected = 0;
+		for (unsigned h = mpParameters->mScreenMinHits; h <= n; h++){
+			double binom = 1;
+			for (unsigned i = 1; i <= h; i++)
+				binom = binom * (n - h + i) / i;
+			expected += binom * pow(p, h) * pow(1-p, n-h);
+		}
+		*fout << "#PARAM\tSCREENHASHFUNC\t" << n << endl;
+		*fout << "#PARAM\tSCREENMINHITS\t" << mpParameters->mScreenMinHits << endl;
+		*fout << "#PARAM\tSCREENEXPECTEDCANDIDATES\t" << expected << endl;
+	}
+	if (mpParameters->mEarlyStopWindows > 0){
+		*fout << "#PARAM\tEARLYSTOPWINDOWS\t" << mpParameters->mEarlyStopWindows << endl;
+		*fout << "#PARAM\tEARLYSTOPERROR\t" << mpParameters->mEarlyStopError << endl;
+		*fout << "#PARAM\tEARLYSTOPHITPROB\t" << mpParameters->mEarlyStopHitProb << endl;
+	}
+	if (mUseHierarchy){
+		*fout << "#PARAM\tHIERARCHY\t" << mpParameters->mIndexHierarchy << endl;
+		*fout << "#PARAM\tHIERARCHYGROUPS\t" << mNumGroups << endl;
+		*fout << "#PARAM\tHIERARCHYGROUPFRACTION\t" << mpParameters->mHierarchyGroupFraction << endl;
+	}
 	*fout << "##" << endl;
 	*fout << "##INDEX MAPPING TABLE" << endl;
 	*fout << "##" << endl;
@@ -793,6 +1628,9 @@ ogzstream* SeqClassifyManager::PrepareResultsFile(string filename){
 	*fout << "##" << endl;
 	*fout << "##SEQUENCE CLASSIFICATION RESULTS" << endl;
 	*fout << "##" << endl;
-	*fout << "#SEQ\tSTR\tSIGS\tSIG_HITS\tHF_HITS\tSUM\tMAX\tIDX\tVALS\tMAX_IDX"<< endl;
+	*fout << "#SEQ\tSTR\tSIGS\tSIG_HITS\tHF_HITS\tSUM\tMAX\tIDX\tVALS\tMAX_IDX";
+	if (mpParameters->mEarlyStopWindows > 0)
+		*fout << "\tALL_SIGS";
+	*fout << endl;
 	return fout;
 }
@@ -11,6 +11,7 @@
 #include "MinHashEncoder.h"
 #include "Data.h"
 #include "Parameters.h"
+#include "SeqBinWriter.h"
 
 #include <math.h>
 
@@ -19,19 +20,109 @@ class SeqClassifyManager: public HistogramIndex {
 public:
 	SeqClassifyManager(Parameters* apParameters, Data* apData);
 
-	struct resultS{
-		string output_line;
+	// result of one sequence and strand as written to the results file, used by the library API
+	struct readResultS{
+		string name;
+		char strand;
+		unsigned numSigs;
+		unsigned matchingSigs;
+		unsigned hits;
+		unsigned sum;
+		unsigned max;
+		unsigned totalSigs;
+		vector<pair<unsigned,unsigned> > labels;	// reported labels (1-based) and their hits
+		vector<unsigned> bestLabels;
+	};
+
+	// results of a chunk: the result lines of all its sequences in one buffer
+	// or, with keepReads, the results as structs
+	struct resultChunkS{
+		string output;
+		unsigned numResults;
 		unsigned numInstances;
+		bool keepReads;
+		vector<readResultS> reads;
+		// results of the additional indexes (--index_bed given several times)
+		vector<std::shared_ptr<resultChunkS> > extra;
+		// sequences per category (--bin_output)
+		vector<SeqBinWriter::BinBufferT> bins;
+		// instances of the classified chunk, counted by the finisher for the termination of the classification
+		unsigned numChunkInstances;
+		resultChunkS():numResults(0),numInstances(0),keepReads(false),numChunkInstances(0){};
 	};
 
-	typedef resultS ResultT;
-	typedef vector<ResultT> ResultChunkT;
+	typedef resultChunkS ResultChunkT;
 	typedef std::shared_ptr<ResultChunkT> ResultChunkP;
 
+	// per label read counts (--abundance_output): a read with a single best label is unique for it,
+	// a read with n best labels is ambiguous for each of them and assigned with 1/n
+	struct labelCountS {
+		uint64_t unique;
+		uint64_t ambiguous;
+		double assigned;
+	};
+	// partial sums of one worker thread, merged after the classification
+	struct abundanceS {
+		vector<labelCountS> labels;
+		uint64_t classified;
+		uint64_t unclassified;
+	};
+	vector<abundanceS> mAbundance;
+
+	// additional indexes (--index_bed given several times), queried with the signatures of this one
+	vector<std::shared_ptr<Parameters> > mExtraParameters;
+	vector<std::shared_ptr<SeqClassifyManager> > mExtraIndexes;
+	vector<ogzstream*> mExtraResultsFiles;
+
+	// --bin_output
+	SeqBinWriter* mpBinWriter;
+
+	// --read_cache_size: histograms of both strands of a sequence, the strand with the smaller hash first;
+	// the canonical strand is kept to tell sequences with the same hash apart
+	struct strandCacheS {
+		vector<pair<unsigned,unsigned> > hist;
+		unsigned emptyBins;
+		unsigned matchingSigs;
+		unsigned numSigs;
+		unsigned totalSigs;
+	};
+	struct readCacheS {
+		string seq;
+		strandCacheS strands[2];
+	};
+	typedef ShardedCache<readCacheS>::ValueP ReadCacheP;
+	ShardedCache<readCacheS> mReadCache;
+
+	// parts of a long sequence classified by different workers (splitSeqs): the histograms and
+	// counts are summed up, the worker that adds the last part reports the sequence
+	struct splitSeqS {
+		SparseHistogram hist;
+		SparseHistogram histRC;
+		unsigned emptyBins;
+		unsigned emptyBinsRC;
+		unsigned matchingSigs;
+		unsigned matchingSigsRC;
+		unsigned numSigs;
+		unsigned numSigsRC;
+		unsigned totalSigs;
+		unsigned totalSigsRC;
+		unsigned parts;
+		unsigned numParts;	// known with the last part, 0 before
+	};
+	std::unordered_map<unsigned, splitSeqS> mSplitSeqs;
+	mutable std::mutex mut_split;
+
 	histogramT metaHist;
 	histogramT metaHistNum;
 	std::atomic_uint mNumSequences;
 	std::atomic_uint mClassifiedInstances;
+	// two-tier query (--screen_hash_functions): instances that were screened / passed the screen
+	std::atomic_uint mScreenedInstances;
+	std::atomic_uint mScreenCandidates;
+	// sequential classification (--early_stop_windows): stopped sequences, evaluated / all windows
+	std::atomic_uint mEarlyStopped;
+	std::atomic<uint64_t> mEvaluatedWindows;
+	std::atomic<uint64_t> mTotalWindows;
 	std::atomic_bool done_output;
 
 	threadsafe_queue<ResultChunkP> res_queue;
@@ -43,16 +134,35 @@ public:
 	mutable std::mutex mut_meta;
 
 	void 			Exec();
+	void 			PublishIndex();
+	void 			MergeIndex();
+	void 			UpdateIndex();
+	void 			LoadIndex();
+	void 			LoadExtraIndexes();
+	void 			ResetCounters();
+	binKeyTy		LoadLabelGroups(const string& filename, vector<binKeyTy>& labelGroups);
+	void 			PrintIndexParameters();
 //	void 			finishUpdate(ChunkP& myData);
-	void 			finishUpdate(ChunkP& myData, ResultChunkP& myResult);
+	void 			finishUpdate(ChunkP& myData, ResultChunkP& myResult, abundanceS* abundance);
 	void 			finishUpdate(ChunkP& myData, unsigned& min, unsigned& max);
+	void			SkippedSequences(SeqFileP& myData, vector<std::shared_ptr<const string> >& aRecords);
 
 	void 			ClassifySeqs();
 	void 			Classify_Signatures(SeqFilesT& myFiles);
 	void 			worker_Classify(int numWorkers, unsigned id);
 	void 			finisher_Results(ogzstream* fout_res);
-	void 			getResultString(string& resT, histogramT hist, unsigned emptyBins, unsigned matchingSigs, unsigned numSigs, string& name, strandTypeT strand);
+	// --early_stop_windows: as ComputeHistogram window by window, the label with the most hits of a window gets a win in wins
+	void			ComputeHistogramWindows(const vector<vector<unsigned> >& aSigArray, SparseHistogram& hist, vector<unsigned>& emptyBins, unsigned sigBegin, unsigned sigEnd, SparseHistogram& windowHist, SparseHistogram& wins);
+	void 			WriteResult(ResultChunkT& resultChunk, SparseHistogram& hist, unsigned emptyBins, unsigned matchingSigs, unsigned numSigs, unsigned totalSigs, string& name, strandTypeT strand);
 	ogzstream* 	PrepareResultsFile(string filename);
+	void			AddAbundance(SparseHistogram& hist, unsigned numSigs, abundanceS& abundance);
+	void			AddBinRecord(ResultChunkT& resultChunk, SparseHistogram& hist, unsigned numSigs, const string& aRecord);
+	void			WriteAbundance(string filename);
+
+	// count of a label that is reported as best label, see --pure_approximate_sim
+	inline bool	BestLabel(unsigned count, unsigned numSigs) const {
+		return mpParameters->mPureApproximateSim == 0 || (double)count / (numSigs*mpParameters->mNumHashFunctions) >= mpParameters->mPureApproximateSim;
+	};
 
 	//inline double minSim(double i) { if (i<mpParameters->mPureApproximateSim) return 0; else return i; };
 };
@@ -0,0 +1,206 @@
+/*
+ * SeqServer.cc
+ *
+ *  Classification daemon (-a SERVE) on a Unix domain socket
+ */
+
+#include "SeqServer.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// requests larger than this are rejected and the connection is closed
+static const uint32_t MAX_SERVE_SEQS = 1U << 20;
+static const uint32_t MAX_SERVE_FIELD = 1U << 28;
+static const uint64_t MAX_SERVE_REQUEST = 1ULL << 30;
+// buffers grow with the received data, not with the announced sizes
+static const uint32_t SERVE_READ_CHUNK = 1U << 20;
+static const uint32_t SERVE_RESERVE_SEQS = 4096;
+
+static bool ReadFull(int fd, void* buf, size_t len){
+	char* p = (char*)buf;
+	while (len > 0){
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+// reads a field of len bytes in chunks, i.e. a wrong length prefix costs at most one chunk of memory
+static bool ReadField(int fd, string& oField, uint32_t len){
+	oField.clear();
+	while (oField.size() < len){
+		size_t pos = oField.size();
+		oField.resize(pos + std::min(len - pos, (size_t)SERVE_READ_CHUNK));
+		if (!ReadFull(fd, &oField[pos], oField.size() - pos))
+			return false;
+	}
+	return true;
+}
+
+static bool WriteFull(int fd, const void* buf, size_t len){
+	const char* p = (const char*)buf;
+	while (len > 0){
+		ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+SeqServer::SeqServer(Parameters* apParameters, Data* apData):mpParameters(apParameters),mpData(apData),mpClassifier(nullptr){
+	mNumClients = 0;
+	mNumRequests = 0;
+	mNumSequences = 0;
+}
+
+SeqServer::~SeqServer(){
+	delete mpClassifier;
+}
+
+void SeqServer::Exec(){
+
+	cout << endl << SEP << endl << "CLASSIFICATION SERVER" << endl << SEP << endl;
+
+	// the index is loaded/attached once for all clients
+	mpClassifier = new SeqClassifier(mpParameters, mpData);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		throw range_error("ERROR SeqServer::Exec: cannot create socket: " + string(strerror(errno)));
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (mpParameters->mServeSocket.size() >= sizeof(addr.sun_path)){
+		close(fd);
+		throw range_error("ERROR SeqServer::Exec: socket path too long: " + mpParameters->mServeSocket);
+	}
+	strncpy(addr.sun_path, mpParameters->mServeSocket.c_str(), sizeof(addr.sun_path)-1);
+
+	// a socket file of a previous server is replaced, any other file is left alone
+	struct stat st;
+	if (lstat(mpParameters->mServeSocket.c_str(), &st) == 0){
+		if (!S_ISSOCK(st.st_mode)){
+			close(fd);
+			throw range_error("ERROR SeqServer::Exec: " + mpParameters->mServeSocket + " exists and is not a socket!");
+		}
+		unlink(mpParameters->mServeSocket.c_str());
+	}
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0){
+		close(fd);
+		throw range_error("ERROR SeqServer::Exec: cannot listen on " + mpParameters->mServeSocket + ": " + string(strerror(errno)));
+	}
+
+	cout << endl << "Listening on " << mpParameters->mServeSocket << " (request queue size " << mpParameters->mServeQueueSize << ")" << endl;
+
+	std::thread classifier(&SeqServer::worker_Classify, this);
+	classifier.detach();
+
+	while (true){
+		int client = accept(fd, nullptr, nullptr);
+		if (client < 0){
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			close(fd);
+			throw range_error("ERROR SeqServer::Exec: accept failed: " + string(strerror(errno)));
+		}
+		std::thread(&SeqServer::worker_Client, this, client).detach();
+	}
+}
+
+bool SeqServer::ReadRequest(int fd, vector<pair<string,string> >& oSeqs){
+
+	uint32_t numSeqs;
+	if (!ReadFull(fd, &numSeqs, sizeof(numSeqs)) || numSeqs == 0 || numSeqs > MAX_SERVE_SEQS)
+		return false;
+
+	oSeqs.clear();
+	oSeqs.reserve(std::min(numSeqs, SERVE_RESERVE_SEQS));
+	uint64_t requestSize = 0;
+	for (uint32_t i = 0; i < numSeqs; i++){
+		oSeqs.push_back(make_pair(string(), string()));
+		string* fields[2] = {&oSeqs.back().first, &oSeqs.back().second};
+		for (unsigned f = 0; f < 2; f++){
+			uint32_t len;
+			if (!ReadFull(fd, &len, sizeof(len)) || len > MAX_SERVE_FIELD)
+				return false;
+			requestSize += len;
+			if (requestSize > MAX_SERVE_REQUEST || !ReadField(fd, *fields[f], len))
+				return false;
+		}
+	}
+	return true;
+}
+
+void SeqServer::worker_Client(int fd){
+
+	mNumClients++;
+	while (true){
+		RequestP myRequest = std::make_shared<requestS>();
+		if (!ReadRequest(fd, myRequest->seqs))
+			break;
+		std::future<string> myResult = myRequest->result.get_future();
+
+		// backpressure: the client is not read from while the queue is full
+		{
+			unique_lock<mutex> lk(mut_req);
+			cv_push.wait(lk, [&]{ return mRequests.size() < mpParameters->mServeQueueSize; });
+			mRequests.push_back(myRequest);
+		}
+		cv_pop.notify_one();
+
+		uint32_t header[2] = {0, 0};
+		string lines;
+		try {
+			lines = myResult.get();
+		} catch (exception& e) {
+			header[0] = 1;
+			lines = e.what();
+		}
+		header[1] = lines.size();
+		if (!WriteFull(fd, header, sizeof(header)) || !WriteFull(fd, lines.data(), lines.size()))
+			break;
+	}
+	close(fd);
+	mNumClients--;
+}
+
+void SeqServer::worker_Classify(){
+
+	while (true){
+		RequestP myRequest;
+		{
+			unique_lock<mutex> lk(mut_req);
+			cv_pop.wait(lk, [&]{ return !mRequests.empty(); });
+			myRequest = mRequests.front();
+			mRequests.pop_front();
+		}
+		cv_push.notify_one();
+
+		// the batch is split over the worker threads of the classifier
+		try {
+			string lines;
+			mpClassifier->Classify(myRequest->seqs, lines);
+			myRequest->result.set_value(lines);
+		} catch (...) {
+			myRequest->result.set_exception(std::current_exception());
+		}
+
+		mNumRequests++;
+		mNumSequences += myRequest->seqs.size();
+		if (mpParameters->mVerbose)
+			cout << "\rrequests=" << mNumRequests << " sequences=" << mNumSequences << " clients=" << mNumClients << "   " << flush;
+	}
+}
@@ -0,0 +1,55 @@
+/*
+ * SeqServer.h
+ *
+ *  Classification daemon (-a SERVE): the index is loaded once, clients send batches of
+ *  sequences over a Unix domain socket and get the result lines back.
+ *
+ *  Framing (integers are uint32 in host byte order):
+ *    request  : numSeqs, then numSeqs times nameLength name seqLength seq; numSeqs=0 ends the connection;
+ *               at most 2^20 sequences, 256 MiB per name/sequence and 1 GiB per request
+ *    response : status (0 ok, 1 error), length, then the result lines (or the error message)
+ */
+
+#ifndef SEQSERVER_H_
+#define SEQSERVER_H_
+
+#include "SeqClassifier.h"
+
+#include <future>
+
+class SeqServer {
+
+public:
+	SeqServer(Parameters* apParameters, Data* apData);
+	~SeqServer();
+
+	void 			Exec();
+
+private:
+	// one batch of a client, the worker fulfills the promise with the result lines
+	struct requestS {
+		vector<pair<string,string> > seqs;
+		std::promise<string> result;
+	};
+	typedef std::shared_ptr<requestS> RequestP;
+
+	void 			worker_Client(int fd);
+	void 			worker_Classify();
+	bool 			ReadRequest(int fd, vector<pair<string,string> >& oSeqs);
+
+	Parameters* 	mpParameters;
+	Data* 			mpData;
+	SeqClassifier* mpClassifier;
+
+	// bounded request queue, a client thread waits while it is full
+	std::deque<RequestP> mRequests;
+	std::mutex 		mut_req;
+	std::condition_variable cv_push;
+	std::condition_variable cv_pop;
+
+	std::atomic_uint mNumClients;
+	std::atomic<uint64_t> mNumRequests;
+	std::atomic<uint64_t> mNumSequences;
+};
+
+#endif /* SEQSERVER_H_ */
@@ -1,4 +1,9 @@
 #include "Utility.h"
+// the vectorised decoder of PostingListCodec is compiled for SSSE3 on x86 and selected at run time
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define POSTING_LIST_SSSE3
+#endif
 
 
 //void MakeShuffledDataIndicesList(vector<unsigned>& oDataIdList, unsigned aSize) {
@@ -298,6 +303,227 @@ void ProgressBar::PrintElapsed(){
 //}
 
 //--------------------------------------------------------------------------------------
+HyperLogLog::HyperLogLog(unsigned aPrecision) :
+		mPrecision(aPrecision), mRegisters((size_t)1 << aPrecision, 0) {
+}
+
+void HyperLogLog::Clear() {
+	std::fill(mRegisters.begin(), mRegisters.end(), 0);
+}
+
+//------------------------------------------------------------------------------------------------------------------------
+const uint32_t BlockedBloomFilter::SALT[8] = {
+		0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+		0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+BlockedBloomFilter::BlockedBloomFilter() :
+		mNumBlocks(0), mAlign(0), mBlocks(nullptr) {
+}
+
+BlockedBloomFilter::BlockedBloomFilter(const BlockedBloomFilter& aOther) :
+		mNumBlocks(0), mAlign(0), mBlocks(nullptr) {
+	*this = aOther;
+}
+
+BlockedBloomFilter& BlockedBloomFilter::operator=(const BlockedBloomFilter& aOther) {
+	if (this == &aOther)
+		return *this;
+	mNumBlocks = aOther.mNumBlocks;
+	if (aOther.mWords.size() == 0){
+		// views share the serialized blocks
+		mWords.clear();
+		mAlign = 0;
+		mBlocks = aOther.mBlocks;
+	} else {
+		Allocate();
+		memcpy(mBlocks, aOther.mBlocks, mNumBlocks * 8 * sizeof(uint32_t));
+	}
+	return *this;
+}
+
+void BlockedBloomFilter::Allocate() {
+	mWords.assign(mNumBlocks * 8 + 8, 0);
+	mAlign = ((32 - ((uintptr_t)&mWords[0] & 31)) & 31) / sizeof(uint32_t);
+	mBlocks = &mWords[mAlign];
+}
+
+void BlockedBloomFilter::Init(uint64_t aNumKeys, unsigned aBitsPerKey) {
+	mNumBlocks = std::max((uint64_t)1, (aNumKeys * aBitsPerKey + 255) / 256);
+	Allocate();
+}
+
+void BlockedBloomFilter::Write(ostream& out) const {
+	out.write((const char*) &mNumBlocks, sizeof(uint64_t));
+	out.write((const char*) mBlocks, mNumBlocks * 8 * sizeof(uint32_t));
+}
+
+bool BlockedBloomFilter::Read(istream& in) {
+	in.read((char*) &mNumBlocks, sizeof(uint64_t));
+	if (!in.good() || mNumBlocks == 0)
+		return false;
+	Allocate();
+	in.read((char*) &mWords[mAlign], mNumBlocks * 8 * sizeof(uint32_t));
+	return in.good();
+}
+
+uint64_t BlockedBloomFilter::View(const char* aData, uint64_t aSize) {
+	uint64_t numBlocks;
+	if (aSize < sizeof(uint64_t))
+		return 0;
+	memcpy(&numBlocks, aData, sizeof(uint64_t));
+	if (numBlocks == 0 || GetSerializedSize(numBlocks) > aSize)
+		return 0;
+	mNumBlocks = numBlocks;
+	mWords.clear();
+	mAlign = 0;
+	// the blocks are only read through a view
+	mBlocks = const_cast<uint32_t*>(reinterpret_cast<const uint32_t*>(aData + sizeof(uint64_t)));
+	return GetSerializedSize(numBlocks);
+}
+
+//------------------------------------------------------------------------------------------------------------------------
+void PostingListCodec::Encode(const uint16_t* aValues, unsigned aSize, vector<uint8_t>& oOut) {
+	unsigned size = aSize;
+	while (size >= 128){
+		oOut.push_back((size & 127) | 128);
+		size >>= 7;
+	}
+	oOut.push_back(size);
+
+	size_t ctrlPos = oOut.size();
+	oOut.resize(oOut.size() + (aSize + 7) / 8, 0);
+	uint16_t prev = 0;
+	for (unsigned i = 0; i < aSize; i++){
+		uint16_t delta = aValues[i] - prev;
+		prev = aValues[i];
+		oOut.push_back(delta & 255);
+		if (delta > 255){
+			oOut[ctrlPos + i / 8] |= 1 << (i % 8);
+			oOut.push_back(delta >> 8);
+		}
+	}
+}
+
+#ifdef POSTING_LIST_SSSE3
+// shuffle masks that expand the 8..16 delta bytes of a group to 8 uint16 lanes
+__attribute__((target("ssse3")))
+static const __m128i* PostingListShuffleTable() {
+	static __m128i table[256];
+	static bool init = [](){
+		for (unsigned c = 0; c < 256; c++){
+			uint8_t mask[16];
+			unsigned pos = 0;
+			for (unsigned i = 0; i < 8; i++){
+				mask[2*i] = pos++;
+				mask[2*i+1] = (c & (1 << i)) ? pos++ : 0x80;
+			}
+			table[c] = _mm_loadu_si128((const __m128i*)mask);
+		}
+		return true;
+	}();
+	(void)init;
+	return table;
+}
+
+__attribute__((target("ssse3")))
+static void PostingListDecodeSSSE3(const uint8_t* ctrl, const uint8_t* data, unsigned size, uint16_t* oValues) {
+	const __m128i* shuffle = PostingListShuffleTable();
+	__m128i prev = _mm_setzero_si128();
+	for (unsigned i = 0; i < size; i += 8){
+		uint8_t c = *ctrl++;
+		__m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), shuffle[c]);
+		data += 8 + __builtin_popcount(c);
+		// prefix sum of the 8 deltas plus the last value of the previous group
+		v = _mm_add_epi16(v, _mm_slli_si128(v, 2));
+		v = _mm_add_epi16(v, _mm_slli_si128(v, 4));
+		v = _mm_add_epi16(v, _mm_slli_si128(v, 8));
+		v = _mm_add_epi16(v, prev);
+		_mm_storeu_si128((__m128i*)(oValues + i), v);
+		prev = _mm_shufflehi_epi16(v, 0xFF);
+		prev = _mm_unpackhi_epi64(prev, prev);
+	}
+}
+#endif
+
+bool PostingListCodec::mVectorised = PostingListCodec::SetVectorised(true);
+
+bool PostingListCodec::SetVectorised(bool aEnable) {
+	mVectorised = false;
+#ifdef POSTING_LIST_SSSE3
+	__builtin_cpu_init();
+	mVectorised = aEnable && __builtin_cpu_supports("ssse3");
+#endif
+	return mVectorised;
+}
+
+unsigned PostingListCodec::Decode(const uint8_t* aIn, uint16_t* oValues) {
+	unsigned size = DecodeSize(aIn);
+	while (*aIn++ & 128);
+
+	const uint8_t* ctrl = aIn;
+	const uint8_t* data = aIn + (size + 7) / 8;
+#ifdef POSTING_LIST_SSSE3
+	if (mVectorised){
+		PostingListDecodeSSSE3(ctrl, data, size, oValues);
+		return size;
+	}
+#endif
+	uint16_t prev = 0;
+	for (unsigned i = 0; i < size; i++){
+		uint16_t delta = *data++;
+		if (ctrl[i / 8] & (1 << (i % 8)))
+			delta |= (uint16_t)(*data++) << 8;
+		prev += delta;
+		oValues[i] = prev;
+	}
+	return size;
+}
+
+unsigned SparseHistogram::Sum() const {
+	unsigned sum = 0;
+	for (unsigned i = 0; i < mTouched.size(); i++)
+		sum += mCounts[mTouched[i]];
+	return sum;
+}
+
+unsigned SparseHistogram::Max() const {
+	unsigned max = 0;
+	for (unsigned i = 0; i < mTouched.size(); i++)
+		max = std::max(max, mCounts[mTouched[i]]);
+	return max;
+}
+
+void SparseHistogram::MaxTwo(unsigned& oFirst, unsigned& oSecond) const {
+	oFirst = 0;
+	oSecond = 0;
+	for (unsigned i = 0; i < mTouched.size(); i++){
+		unsigned count = mCounts[mTouched[i]];
+		if (count > oFirst){
+			oSecond = oFirst;
+			oFirst = count;
+		} else if (count > oSecond)
+			oSecond = count;
+	}
+}
+
+double HyperLogLog::Estimate() const {
+	const double m = mRegisters.size();
+	double alpha = 0.7213 / (1.0 + 1.079 / m);
+	double sum = 0;
+	unsigned zeros = 0;
+	for (size_t i = 0; i < mRegisters.size(); i++) {
+		sum += std::ldexp(1.0, -mRegisters[i]);
+		if (mRegisters[i] == 0)
+			zeros++;
+	}
+	double estimate = alpha * m * m / sum;
+	// small range correction: linear counting
+	if (estimate <= 2.5 * m && zeros > 0)
+		estimate = m * std::log(m / zeros);
+	return estimate;
+}
+
+//------------------------------------------------------------------------------------------------------------------------
 OutputManager::OutputManager(string aFileName, string aDirectoryPath) :
 		mFileName(aFileName), mDirectoryPath(aDirectoryPath) {
 	if (mDirectoryPath != "") {
@@ -324,10 +550,14 @@ OutputManager::OutputManager(string aFileName, string aDirectoryPath) :
 }
 
 string OutputManager::GetFullPathFileName() {
+	return GetFullPathFileName(mFileName, mDirectoryPath);
+}
+
+string OutputManager::GetFullPathFileName(const string& aFileName, const string& aDirectoryPath) {
 	string output_filename;
-	if (mDirectoryPath != "")
-		output_filename = mDirectoryPath + "/" + mFileName;
-	else output_filename = mFileName;
+	if (aDirectoryPath != "")
+		output_filename = aDirectoryPath + "/" + aFileName;
+	else output_filename = aFileName;
 	return output_filename;
 }
 
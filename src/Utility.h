@@ -32,6 +32,7 @@
 #include <atomic>
 #include <chrono>
 #include <deque>
+#include <unordered_map>
 
 #ifdef USEMULTITHREAD
 #include <omp.h>
@@ -238,6 +239,234 @@ private:
 	TimerClass mTimer;
 };
 
+//------------------------------------------------------------------------------------------------------------------------
+///HyperLogLog cardinality estimator (Flajolet et al. 2007) with 2^aPrecision
+///registers; the relative standard error is about 1.04/sqrt(2^aPrecision).
+class HyperLogLog {
+public:
+	HyperLogLog(unsigned aPrecision = 14);
+
+	inline void Add(uint64_t aValue) {
+		// values are mixed first (splitmix64 finalizer), index keys are masked hash values
+		aValue += 0x9E3779B97F4A7C15ULL;
+		aValue = (aValue ^ (aValue >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		aValue = (aValue ^ (aValue >> 27)) * 0x94D049BB133111EBULL;
+		aValue ^= aValue >> 31;
+		unsigned reg = aValue >> (64 - mPrecision);
+		uint64_t rest = (aValue << mPrecision) | ((uint64_t)1 << (mPrecision - 1));
+		uint8_t rank = __builtin_clzll(rest) + 1;
+		if (rank > mRegisters[reg])
+			mRegisters[reg] = rank;
+	}
+	double	Estimate() const;
+	void		Clear();
+private:
+	unsigned mPrecision;
+	vector<uint8_t> mRegisters;
+};
+
+//------------------------------------------------------------------------------------------------------------------------
+///Split block Bloom filter: a key selects one block of 8 32-bit words (32 bytes, blocks are
+///aligned so that they do not cross cache lines) and sets one bit in each word. A query checks one block only and
+///the 8 word tests are independent, i.e. they vectorize (e.g. with -mavx2).
+///A filter either owns its blocks or is a read-only view of a serialized filter (e.g. in shared memory).
+class BlockedBloomFilter {
+public:
+	BlockedBloomFilter();
+	BlockedBloomFilter(const BlockedBloomFilter& aOther);
+	BlockedBloomFilter& operator=(const BlockedBloomFilter& aOther);
+
+	void		Init(uint64_t aNumKeys, unsigned aBitsPerKey);
+	inline void Add(unsigned aKey) {
+		uint64_t h = Hash(aKey);
+		uint32_t* block = &mBlocks[(((h >> 32) * mNumBlocks) >> 32) * 8];
+		for (unsigned i = 0; i < 8; i++)
+			block[i] |= (uint32_t)1 << (((uint32_t)h * SALT[i]) >> 27);
+	}
+	inline bool MayContain(unsigned aKey) const {
+		uint64_t h = Hash(aKey);
+		const uint32_t* block = &mBlocks[(((h >> 32) * mNumBlocks) >> 32) * 8];
+		uint32_t miss = 0;
+		for (unsigned i = 0; i < 8; i++)
+			miss |= ~block[i] & ((uint32_t)1 << (((uint32_t)h * SALT[i]) >> 27));
+		return miss == 0;
+	}
+	inline void Prefetch(unsigned aKey) const {
+		__builtin_prefetch(&mBlocks[(((Hash(aKey) >> 32) * mNumBlocks) >> 32) * 8]);
+	}
+	uint64_t	GetNumBlocks() const { return mNumBlocks; };
+	void		Write(ostream& out) const;
+	bool		Read(istream& in);
+	// serialized size of a filter with aNumBlocks blocks
+	static uint64_t GetSerializedSize(uint64_t aNumBlocks) { return sizeof(uint64_t) + aNumBlocks * 8 * sizeof(uint32_t); };
+	// uses the filter serialized at aData (at most aSize bytes) without copying it, returns the used bytes or 0;
+	// aData has to stay mapped and should be 32 byte aligned after the block count
+	uint64_t	View(const char* aData, uint64_t aSize);
+
+private:
+	static const uint32_t SALT[8];
+
+	static inline uint64_t Hash(unsigned aKey) {
+		uint64_t h = ((uint64_t)aKey + 0x9E3779B97F4A7C15ULL) * 0xBF58476D1CE4E5B9ULL;
+		return h ^ (h >> 31);
+	}
+
+	void		Allocate();
+
+	uint64_t mNumBlocks;
+	// blocks start at mWords[mAlign], views leave mWords empty
+	unsigned mAlign;
+	vector<uint32_t> mWords;
+	uint32_t* mBlocks;
+};
+
+//------------------------------------------------------------------------------------------------------------------------
+///Compressed posting list of sorted uint16 values: the number of values (varint), one control
+///byte per group of 8 values (bit i set: delta i takes 2 bytes) and the deltas to the previous
+///value in 1 or 2 bytes each (StreamVByte like layout). Decode() reads up to 16 bytes past the
+///last delta and writes values up to the next multiple of 8, buffers have to be padded.
+class PostingListCodec {
+public:
+	static const unsigned PADDING = 16;
+
+	static void			Encode(const uint16_t* aValues, unsigned aSize, vector<uint8_t>& oOut);
+	static unsigned	Decode(const uint8_t* aIn, uint16_t* oValues);
+	// the vectorised (SSSE3) decoder is used if the CPU supports it and it is enabled, returns whether it is used
+	static bool			SetVectorised(bool aEnable);
+	static bool			IsVectorised() { return mVectorised; };
+	static inline unsigned DecodeSize(const uint8_t* aIn) {
+		unsigned size = 0;
+		for (unsigned shift = 0;; shift += 7){
+			size |= (unsigned)(*aIn & 127) << shift;
+			if ((*aIn++ & 128) == 0)
+				return size;
+		}
+	}
+private:
+	static bool			mVectorised;
+};
+
+//------------------------------------------------------------------------------------------------------------------------
+///Appends the decimal digits of aValue to oOut without temporary strings (like std::to_chars)
+inline void AppendUnsigned(string& oOut, uint64_t aValue) {
+	char buf[20];
+	char* p = buf + sizeof(buf);
+	do {
+		*--p = '0' + aValue % 10;
+		aValue /= 10;
+	} while (aValue != 0);
+	oOut.append(p, buf + sizeof(buf) - p);
+}
+
+///64 bit FNV-1a hash of a sequence with a final mix of the bits
+inline uint64_t SeqHash64(const string& aSeq) {
+	uint64_t h = 14695981039346656037ULL;
+	for (unsigned i = 0; i < aSeq.size(); i++) {
+		h ^= (unsigned char) aSeq[i];
+		h *= 1099511628211ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
+//------------------------------------------------------------------------------------------------------------------------
+///Histogram of integer counts over a large index range of which only a few entries are used:
+///the dense counters are reset through the list of touched entries, Sum(), Max() and the
+///iteration over the touched entries do not depend on the size of the histogram.
+class SparseHistogram {
+public:
+	void		Init(unsigned aSize) { mCounts.assign(aSize, 0); mTouched.clear(); }
+	inline void	Add(unsigned aIdx, unsigned aCount) {
+		if (mCounts[aIdx] == 0)
+			mTouched.push_back(aIdx);
+		mCounts[aIdx] += aCount;
+	}
+	void		Add(const SparseHistogram& aHist) {
+		for (unsigned i = 0; i < aHist.mTouched.size(); i++)
+			Add(aHist.mTouched[i], aHist.mCounts[aHist.mTouched[i]]);
+	}
+	void		Clear() {
+		for (unsigned i = 0; i < mTouched.size(); i++)
+			mCounts[mTouched[i]] = 0;
+		mTouched.clear();
+	}
+	inline unsigned operator[](unsigned aIdx) const { return mCounts[aIdx]; }
+	unsigned	Size() const { return mCounts.size(); }
+	///touched entries in insertion order, SortTouched() orders them by index
+	const vector<unsigned>& Touched() const { return mTouched; }
+	void		SortTouched() { sort(mTouched.begin(), mTouched.end()); }
+	unsigned	Sum() const;
+	unsigned	Max() const;
+	///largest and second largest count
+	void		MaxTwo(unsigned& oFirst, unsigned& oSecond) const;
+private:
+	vector<unsigned> mCounts;
+	vector<unsigned> mTouched;
+};
+
+//------------------------------------------------------------------------------------------------------------------------
+///Bounded map from 64 bit keys to shared values for concurrent use: the keys are distributed
+///over shards with a lock each, a full shard evicts its oldest entry. Keys are hashes, Get
+///verifies a found value with a predicate, only verified values count as hits.
+template<typename T>
+class ShardedCache {
+public:
+	typedef std::shared_ptr<const T> ValueP;
+
+	ShardedCache():mShardCapacity(0) { mHits = 0; mMisses = 0; }
+	void		Init(uint64_t aCapacity, unsigned aNumShards = 64) {
+		mShards.clear();
+		for (unsigned i = 0; i < aNumShards; i++)
+			mShards.push_back(std::make_shared<shardS>());
+		mShardCapacity = std::max((uint64_t)1, aCapacity / aNumShards);
+		mHits = 0;
+		mMisses = 0;
+	}
+	bool		Enabled() const { return mShardCapacity > 0; }
+	template<typename MatchT>
+	bool		Get(uint64_t aKey, ValueP& oValue, MatchT aMatch) {
+		shardS& shard = *mShards[aKey % mShards.size()];
+		{
+			std::lock_guard<std::mutex> lk(shard.mut);
+			typename std::unordered_map<uint64_t, ValueP>::const_iterator it = shard.entries.find(aKey);
+			if (it != shard.entries.end())
+				oValue = it->second;
+		}
+		if (oValue && aMatch(*oValue)) {
+			mHits++;
+			return true;
+		}
+		oValue.reset();
+		mMisses++;
+		return false;
+	}
+	void		Put(uint64_t aKey, const ValueP& aValue) {
+		shardS& shard = *mShards[aKey % mShards.size()];
+		std::lock_guard<std::mutex> lk(shard.mut);
+		if (!shard.entries.insert(make_pair(aKey, aValue)).second)
+			return;
+		shard.order.push_back(aKey);
+		if (shard.order.size() > mShardCapacity) {
+			shard.entries.erase(shard.order.front());
+			shard.order.pop_front();
+		}
+	}
+	uint64_t	Hits() const { return mHits; }
+	uint64_t	Misses() const { return mMisses; }
+private:
+	struct shardS {
+		std::mutex mut;
+		std::unordered_map<uint64_t, ValueP> entries;
+		std::deque<uint64_t> order;
+	};
+	vector<std::shared_ptr<shardS> > mShards;
+	uint64_t mShardCapacity;
+	std::atomic<uint64_t> mHits;
+	std::atomic<uint64_t> mMisses;
+};
+
 //------------------------------------------------------------------------------------------------------------------------
 ///Implements safe access policies to a vector container and offers
 ///members to compute various statistical estimators.
@@ -283,6 +512,7 @@ protected:
 public:
 	OutputManager(string aFileName,string aDirectoryPath);
 	string GetFullPathFileName();
+	static string GetFullPathFileName(const string& aFileName, const string& aDirectoryPath);
 };
 
 
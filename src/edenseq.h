@@ -0,0 +1,54 @@
+/*
+ * edenseq.h
+ *
+ *  C interface of libedenseq, see SeqClassifier.h for the C++ interface.
+ */
+
+#ifndef EDENSEQ_H_
+#define EDENSEQ_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct edenseq_classifier edenseq_classifier;
+
+/* result of one sequence, the fields are the columns of the results file */
+typedef struct {
+	const char* name;
+	char strand;
+	unsigned num_sigs;
+	unsigned matching_sigs;
+	unsigned hits;
+	unsigned sum;
+	unsigned max;
+	unsigned total_sigs;
+	unsigned num_labels;
+	const unsigned* labels;		/* reported labels, 1-based */
+	const unsigned* label_hits;
+	unsigned num_best_labels;
+	const unsigned* best_labels;
+} edenseq_result;
+
+/* options as on the command line without the program name, NULL on error (see edenseq_last_error) */
+edenseq_classifier* edenseq_create(int argc, const char** argv);
+void edenseq_destroy(edenseq_classifier* classifier);
+
+/* classifies n sequences, *results holds n results in input order and is freed by edenseq_free_results;
+   returns 0 on success and -1 on error */
+int edenseq_classify(edenseq_classifier* classifier, size_t n, const char** names, const char** seqs, edenseq_result** results);
+void edenseq_free_results(edenseq_result* results, size_t n);
+
+unsigned edenseq_num_labels(const edenseq_classifier* classifier);
+const char* edenseq_label_name(const edenseq_classifier* classifier, unsigned label);
+
+/* message of the last failed call of the calling thread */
+const char* edenseq_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EDENSEQ_H_ */
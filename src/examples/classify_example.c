@@ -0,0 +1,102 @@
+/*
+ * classify_example.c
+ *
+ *  Classifies the sequences of an uncompressed FASTA file with libedenseq and
+ *  prints the best labels of each sequence.
+ *
+ *  usage: classify_example <reads.fa> --index_seqs <genomes.fa> --index_bed <index.bed> [EDeNseq options]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "edenseq.h"
+
+#define BATCH_SIZE 1000
+#define MAX_LINE 65536
+
+static void print_results(const edenseq_classifier* classifier, const edenseq_result* results, size_t n){
+	size_t i;
+	unsigned k;
+	for (i = 0; i < n; i++){
+		printf("%s\t%c\t%u\t%u", results[i].name, results[i].strand, results[i].num_sigs, results[i].max);
+		for (k = 0; k < results[i].num_best_labels; k++)
+			printf("%c%s", k == 0 ? '\t' : ',', edenseq_label_name(classifier, results[i].best_labels[k]));
+		printf("\n");
+	}
+}
+
+static int classify_batch(edenseq_classifier* classifier, size_t n, const char** names, const char** seqs){
+	edenseq_result* results;
+	if (edenseq_classify(classifier, n, names, seqs, &results) != 0){
+		fprintf(stderr, "%s\n", edenseq_last_error());
+		return -1;
+	}
+	print_results(classifier, results, n);
+	edenseq_free_results(results, n);
+	return 0;
+}
+
+int main(int argc, const char** argv){
+	edenseq_classifier* classifier;
+	FILE* in;
+	char line[MAX_LINE];
+	char* names[BATCH_SIZE];
+	char* seqs[BATCH_SIZE];
+	size_t seqLen[BATCH_SIZE];
+	size_t n = 0, i;
+	int status = 0;
+
+	if (argc < 2){
+		fprintf(stderr, "usage: %s <reads.fa> --index_seqs <genomes.fa> --index_bed <index.bed> [EDeNseq options]\n", argv[0]);
+		return 1;
+	}
+	in = fopen(argv[1], "r");
+	if (in == NULL){
+		fprintf(stderr, "cannot open %s\n", argv[1]);
+		return 1;
+	}
+
+	/* the index is loaded once */
+	classifier = edenseq_create(argc - 2, argv + 2);
+	if (classifier == NULL){
+		fprintf(stderr, "%s\n", edenseq_last_error());
+		fclose(in);
+		return 1;
+	}
+	fprintf(stderr, "index with %u labels loaded\n", edenseq_num_labels(classifier));
+
+	while (status == 0 && fgets(line, MAX_LINE, in) != NULL){
+		size_t len = strcspn(line, "\r\n");
+		line[len] = '\0';
+		if (line[0] == '>'){
+			if (n == BATCH_SIZE){
+				status = classify_batch(classifier, n, (const char**)names, (const char**)seqs);
+				for (i = 0; i < n; i++){
+					free(names[i]);
+					free(seqs[i]);
+				}
+				n = 0;
+			}
+			names[n] = strdup(strtok(line + 1, " \t") ? line + 1 : "");
+			seqs[n] = calloc(1, 1);
+			seqLen[n] = 0;
+			n++;
+		} else if (n > 0 && len > 0){
+			seqs[n-1] = realloc(seqs[n-1], seqLen[n-1] + len + 1);
+			memcpy(seqs[n-1] + seqLen[n-1], line, len + 1);
+			seqLen[n-1] += len;
+		}
+	}
+	if (status == 0 && n > 0)
+		status = classify_batch(classifier, n, (const char**)names, (const char**)seqs);
+	for (i = 0; i < n; i++){
+		free(names[i]);
+		free(seqs[i]);
+	}
+
+	edenseq_destroy(classifier);
+	fclose(in);
+	return status == 0 ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+/*
+ * serve_client.c
+ *
+ *  Test client of EDeNseq -a SERVE: sends the sequences of an uncompressed FASTA file in
+ *  batches to the server and writes the result lines to stdout. See SeqServer.h for the framing.
+ *
+ *  usage: serve_client <socket> <reads.fa> [batch size, default 1000]
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MAX_LINE 65536
+
+static int write_full(int fd, const void* buf, size_t len){
+	const char* p = buf;
+	while (len > 0){
+		ssize_t n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int read_full(int fd, void* buf, size_t len){
+	char* p = buf;
+	while (len > 0){
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int write_field(int fd, const char* s, uint32_t len){
+	if (write_full(fd, &len, sizeof(len)) != 0)
+		return -1;
+	return write_full(fd, s, len);
+}
+
+/* sends one batch and writes the result lines of the response to stdout */
+static int classify_batch(int fd, uint32_t n, char** names, char** seqs, uint32_t* seqLen){
+	uint32_t i, header[2];
+	char* lines;
+
+	if (write_full(fd, &n, sizeof(n)) != 0)
+		return -1;
+	for (i = 0; i < n; i++){
+		if (write_field(fd, names[i], strlen(names[i])) != 0 || write_field(fd, seqs[i], seqLen[i]) != 0)
+			return -1;
+	}
+
+	if (read_full(fd, header, sizeof(header)) != 0)
+		return -1;
+	lines = malloc(header[1] + 1);
+	if (lines == NULL || read_full(fd, lines, header[1]) != 0){
+		free(lines);
+		return -1;
+	}
+	lines[header[1]] = '\0';
+	if (header[0] != 0)
+		fprintf(stderr, "server error: %s\n", lines);
+	else
+		fwrite(lines, 1, header[1], stdout);
+	free(lines);
+	return header[0] == 0 ? 0 : -1;
+}
+
+int main(int argc, char** argv){
+	struct sockaddr_un addr;
+	FILE* in;
+	char line[MAX_LINE];
+	char** names;
+	char** seqs;
+	uint32_t* seqLen;
+	uint32_t batchSize = 1000, n = 0, i, end = 0;
+	int fd, status = 0;
+
+	if (argc < 3){
+		fprintf(stderr, "usage: %s <socket> <reads.fa> [batch size]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 3)
+		batchSize = strtoul(argv[3], NULL, 10);
+	if (batchSize == 0)
+		batchSize = 1000;
+
+	in = fopen(argv[2], "r");
+	if (in == NULL){
+		fprintf(stderr, "cannot open %s\n", argv[2]);
+		return 1;
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+	if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+		fprintf(stderr, "cannot connect to %s: %s\n", argv[1], strerror(errno));
+		fclose(in);
+		return 1;
+	}
+
+	names = malloc(batchSize * sizeof(char*));
+	seqs = malloc(batchSize * sizeof(char*));
+	seqLen = malloc(batchSize * sizeof(uint32_t));
+
+	while (status == 0 && fgets(line, MAX_LINE, in) != NULL){
+		size_t len = strcspn(line, "\r\n");
+		line[len] = '\0';
+		if (line[0] == '>'){
+			if (n == batchSize){
+				status = classify_batch(fd, n, names, seqs, seqLen);
+				for (i = 0; i < n; i++){
+					free(names[i]);
+					free(seqs[i]);
+				}
+				n = 0;
+			}
+			names[n] = strdup(strtok(line + 1, " \t") ? line + 1 : "");
+			seqs[n] = calloc(1, 1);
+			seqLen[n] = 0;
+			n++;
+		} else if (n > 0 && len > 0){
+			seqs[n-1] = realloc(seqs[n-1], seqLen[n-1] + len + 1);
+			memcpy(seqs[n-1] + seqLen[n-1], line, len + 1);
+			seqLen[n-1] += len;
+		}
+	}
+	if (status == 0 && n > 0)
+		status = classify_batch(fd, n, names, seqs, seqLen);
+	for (i = 0; i < n; i++){
+		free(names[i]);
+		free(seqs[i]);
+	}
+
+	/* an empty batch ends the connection */
+	write_full(fd, &end, sizeof(end));
+	close(fd);
+	free(names);
+	free(seqs);
+	free(seqLen);
+	fclose(in);
+	return status == 0 ? 0 : 1;
+}